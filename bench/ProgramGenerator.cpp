@@ -0,0 +1,209 @@
+#include "ProgramGenerator.h"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <random>
+
+namespace {
+class Generator {
+public:
+    explicit Generator(const GeneratorOptions& options)
+            : m_options(options)
+            , m_rng(options.seed)
+    {
+        m_options.identifiers = std::max(1u, m_options.identifiers);
+        m_options.arraySize = std::max(1u, m_options.arraySize);
+    }
+
+    std::string run()
+    {
+        m_out += "program generated;\n\n";
+
+        m_out += "const\n";
+        for (unsigned i = 0; i < 4; i++)
+            m_out += "    C" + std::to_string(i) + " = " + std::to_string(pick(1, 100)) + ";\n";
+        m_out += "\n";
+
+        for (unsigned i = 0; i < m_options.identifiers; i++)
+            m_out += "var V" + std::to_string(i) + " : integer;\n";
+        for (unsigned i = 0; i < m_options.arrays; i++)
+            m_out += "var A" + std::to_string(i) + " : array [0 .. " + std::to_string(m_options.arraySize - 1) + "] of integer;\n";
+        // Loop counters are never assigned by generated statements, so every loop terminates
+        for (unsigned i = 0; i <= m_options.nestingDepth; i++)
+            m_out += "var L" + std::to_string(i) + " : integer;\n";
+
+        // Everything starts out initialized, running the program is deterministic
+        m_out += "\nbegin\n";
+        for (unsigned i = 0; i < m_options.identifiers; i++)
+            m_out += "  V" + std::to_string(i) + " := " + std::to_string(i) + ";\n";
+        for (unsigned i = 0; i < m_options.arrays; i++)
+            m_out += "  for L0 := 0 to " + std::to_string(m_options.arraySize) + " do A" + std::to_string(i) + "[L0] := L0;\n";
+        m_remaining = std::max(1u, m_options.statements);
+        while (m_remaining > 0)
+            statement(1, 0);
+        m_out += "end.\n";
+
+        return std::move(m_out);
+    }
+
+private:
+    unsigned pick(unsigned low, unsigned high) { return std::uniform_int_distribution<unsigned>(low, high)(m_rng); }
+
+    std::string scalar() { return "V" + std::to_string(pick(0, m_options.identifiers - 1)); }
+
+    void indent(unsigned level) { m_out.append(level * 2, ' '); }
+
+    // Long literals in every base, the lexer's number scanning dominates
+    void literal()
+    {
+        static const char digits[] = "0123456789ABCDEF";
+        unsigned value = std::uniform_int_distribution<unsigned>(0, 0x7FFFFFFF)(m_rng);
+        unsigned base = std::array<unsigned, 3> {10, 16, 8}[pick(0, 2)];
+        char text[16];
+        char* p = std::end(text);
+        do {
+            *--p = digits[value % base];
+            value /= base;
+        } while (value != 0);
+        if (base == 16)
+            m_out += '$';
+        else if (base == 8)
+            m_out += '&';
+        m_out.append(p, std::end(text));
+    }
+
+    void expression(unsigned depth)
+    {
+        if (depth == 0) {
+            if (m_options.literals > 0 && pick(0, 99) < m_options.literals) {
+                literal();
+                return;
+            }
+            unsigned kind = pick(0, m_options.arrays > 0 ? 3 : 2);
+            if (kind == 0)
+                m_out += std::to_string(pick(0, 1000));
+            else if (kind == 1)
+                m_out += "C" + std::to_string(pick(0, 3));
+            else if (kind == 2)
+                m_out += scalar();
+            else
+                m_out += "A" + std::to_string(pick(0, m_options.arrays - 1)) + "[" + std::to_string(pick(0, m_options.arraySize - 1)) + "]";
+            return;
+        }
+
+        static const char* const ops[] = {" + ", " - ", " * ", " div ", " mod "};
+        unsigned op = pick(0, 4);
+        m_out += "(";
+        expression(depth - 1);
+        m_out += ops[op];
+        // Divisors are positive constants, the program never traps
+        if (op >= 3)
+            m_out += pick(0, 1) ? "C" + std::to_string(pick(0, 3)) : std::to_string(pick(1, 1000));
+        else
+            expression(pick(0, depth - 1));
+        m_out += ")";
+    }
+
+    void condition()
+    {
+        static const char* const cmps[] = {" < ", " > ", " <= ", " >= ", " = ", " <> "};
+        m_out += "(";
+        expression(std::min(1u, m_options.exprDepth));
+        m_out += cmps[pick(0, 5)];
+        expression(std::min(1u, m_options.exprDepth));
+        m_out += ")";
+        if (pick(0, 3) == 0) {
+            m_out += pick(0, 1) ? " and (" : " or (";
+            expression(0);
+            m_out += cmps[pick(0, 5)];
+            expression(0);
+            m_out += ")";
+        }
+    }
+
+    void block(unsigned level, unsigned nesting, const std::string& last = "")
+    {
+        unsigned count = std::min(m_remaining, pick(1, 4));
+        m_out += "begin\n";
+        for (unsigned i = 0; i < count && m_remaining > 0; i++)
+            statement(level + 1, nesting);
+        if (!last.empty()) {
+            indent(level + 1);
+            m_out += last;
+        }
+        indent(level);
+        m_out += "end;\n";
+    }
+
+    void statement(unsigned level, unsigned nesting)
+    {
+        m_remaining--;
+        indent(level);
+
+        unsigned kind = pick(0, 9);
+        if (nesting >= m_options.nestingDepth || m_remaining == 0)
+            kind = std::min(kind, 5u);
+
+        switch (kind) {
+            case 0:
+            case 1:
+            case 2:
+                m_out += scalar() + " := ";
+                expression(m_options.exprDepth);
+                m_out += ";\n";
+                break;
+            case 3:
+            case 4:
+                if (m_options.arrays > 0) {
+                    m_out += "A" + std::to_string(pick(0, m_options.arrays - 1)) + "[" + std::to_string(pick(0, m_options.arraySize - 1)) + "] := ";
+                    expression(m_options.exprDepth);
+                    m_out += ";\n";
+                    break;
+                }
+                [[fallthrough]];
+            case 5:
+                m_out += pick(0, 1) ? "writeln(" : "write(";
+                expression(m_options.exprDepth);
+                m_out += ");\n";
+                break;
+            case 6:
+            case 7:
+                m_out += "if ";
+                condition();
+                m_out += " then ";
+                block(level, nesting + 1);
+                if (pick(0, 1) && m_remaining > 0) {
+                    indent(level);
+                    m_out += "else ";
+                    block(level, nesting + 1);
+                }
+                break;
+            case 8:
+                m_out += "for L" + std::to_string(nesting) + " := 0 to " + std::to_string(pick(1, 8)) + " do ";
+                block(level, nesting + 1);
+                break;
+            default: {
+                std::string counter = "L" + std::to_string(nesting);
+                m_out += counter + " := 0;\n";
+                indent(level);
+                m_out += "while (" + counter + " < " + std::to_string(pick(1, 8)) + ") and ";
+                condition();
+                m_out += " do ";
+                block(level, nesting + 1, counter + " := " + counter + " + 1;\n");
+                break;
+            }
+        }
+    }
+
+    GeneratorOptions m_options;
+    std::mt19937 m_rng;
+    std::string m_out;
+    unsigned m_remaining = 0;
+};
+}
+
+std::string GenerateProgram(const GeneratorOptions& options)
+{
+    return Generator(options).run();
+}
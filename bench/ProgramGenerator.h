@@ -0,0 +1,23 @@
+#ifndef PJPPROJECT_PROGRAMGENERATOR_HPP
+#define PJPPROJECT_PROGRAMGENERATOR_HPP
+
+#include <string>
+
+/*
+ * Knobs of a generated Mila program. The output only uses what the parser accepts:
+ * constants, integer scalars and arrays, assignments, if/else, while, for, write and writeln.
+ */
+struct GeneratorOptions {
+    unsigned statements = 1000;     // statements in total, nested ones included
+    unsigned exprDepth = 3;         // depth of the operator tree of each expression
+    unsigned identifiers = 16;      // declared integer scalars
+    unsigned nestingDepth = 2;      // how deep if/while/for may nest
+    unsigned arraySize = 64;        // elements of each array
+    unsigned arrays = 2;            // declared arrays
+    unsigned literals = 0;          // percent of expression leaves that are decimal, $hex or &octal literals up to 2^31-1
+    unsigned seed = 1;              // same options and seed give the same program
+};
+
+std::string GenerateProgram(const GeneratorOptions& options);
+
+#endif //PJPPROJECT_PROGRAMGENERATOR_HPP
@@ -0,0 +1,494 @@
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "ASTFile.h"
+#include "CharScan.h"
+#include "Parser.h"
+#include "Stats.h"
+#include "ast_visitor.h"
+#include "ProgramGenerator.h"
+
+/*
+ * Generates Mila programs of growing size and measures every frontend stage on them:
+ * lexer tokens/s, parser AST nodes/s, codegen IR instructions/s and end-to-end compile latency.
+ * One knob is swept (--sweep, --values), the others stay at their defaults or the given value.
+ */
+
+static llvm::cl::OptionCategory BenchCategory("Frontend benchmark options");
+
+static llvm::cl::opt<unsigned> Statements("statements", llvm::cl::desc("Statements per program"), llvm::cl::init(1000), llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<unsigned> ExprDepth("expr-depth", llvm::cl::desc("Depth of every generated expression"), llvm::cl::init(3), llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<unsigned> Identifiers("identifiers", llvm::cl::desc("Declared integer variables"), llvm::cl::init(16), llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<unsigned> Nesting("nesting", llvm::cl::desc("Maximum nesting of if/while/for"), llvm::cl::init(2), llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<unsigned> ArraySize("array-size", llvm::cl::desc("Elements of each declared array"), llvm::cl::init(64), llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<unsigned> Literals("literals", llvm::cl::desc("Percent of expression leaves that are decimal, hex or octal literals"), llvm::cl::init(0), llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<unsigned> Seed("seed", llvm::cl::desc("Seed of the program generator"), llvm::cl::init(1), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<std::string> Sweep("sweep", llvm::cl::desc("Knob to sweep: statements, expr-depth, identifiers, nesting, array-size, literals or none"),
+                                        llvm::cl::init("statements"), llvm::cl::cat(BenchCategory));
+static llvm::cl::list<unsigned> Values("values", llvm::cl::desc("Values of the swept knob (default 1000,2000,4000,8000,16000 statements)"),
+                                       llvm::cl::CommaSeparated, llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<unsigned> Repeat("repeat", llvm::cl::desc("Runs per measurement, the median is reported"), llvm::cl::init(5), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<std::string> Scanner("scanner", llvm::cl::desc("Character scanners of the lexer: avx2, sse2 or scalar (default: the best this CPU has)"),
+                                          llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<std::string> JSONFile("json", llvm::cl::desc("Also write the results as JSON to <file>, '-' for stdout"),
+                                           llvm::cl::value_desc("file"), llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<std::string> EmitSource("emit-source", llvm::cl::desc("Write the program of the current knobs to <file> and exit"),
+                                             llvm::cl::value_desc("file"), llvm::cl::cat(BenchCategory));
+
+// The bench runs itself with these to measure the peak RSS of one compilation in a fresh process
+static llvm::cl::opt<std::string> CompileMode("compile-mode", llvm::cl::desc("Compile --compile-source whole, released or pipelined and print the peak RSS"),
+                                              llvm::cl::Hidden);
+static llvm::cl::opt<std::string> CompileSource("compile-source", llvm::cl::Hidden);
+
+static std::string BenchPath;
+
+namespace {
+struct Result {
+    GeneratorOptions options;
+    size_t bytes = 0;
+    uint64_t tokens = 0;
+    uint64_t astNodes = 0;
+    uint64_t instructions = 0;
+    double lexSeconds = 0;          // lexing alone
+    double parseSeconds = 0;        // parsing, lexing included
+    double codegenSeconds = 0;
+    double endToEndSeconds = 0;     // parse, codegen, verify and print the IR
+    double pipelinedSeconds = 0;    // the same with Parser::ParseAndGenerate
+    size_t astBytes = 0;            // the AST file of the program
+    double astWriteSeconds = 0;
+    double astLoadSeconds = 0;      // open, which checks every node, and a walk over all of them
+    long peakRSS = 0;               // KiB
+    // KiB, peak of one end-to-end compilation each: the whole AST kept, statements released once lowered, pipelined
+    long wholeASTRSS = 0;
+    long releasedASTRSS = 0;
+    long pipelinedRSS = 0;
+};
+
+class NodeCounter : public RecursiveASTVisitor<NodeCounter> {
+public:
+    void visitNode(const ASTNode&) { count++; }
+    uint64_t count = 0;
+};
+
+// Nodes of an AST file reached from `index`, what a tool walking the file in place does
+uint64_t CountRecords(const ASTFile& file, uint32_t index)
+{
+    if (index == ASTFile::NoNode)
+        return 0;
+    const ASTRecord& node = file.getNode(index);
+    auto countList = [&](uint32_t first, uint32_t count) {
+        uint64_t nodes = 0;
+        for (uint32_t child : file.getList(first, count))
+            nodes += CountRecords(file, child);
+        return nodes;
+    };
+
+    switch (node.getKind()) {
+        case ASTKind::BinOp:
+        case ASTKind::Assign:
+            return 1 + CountRecords(file, node.a) + CountRecords(file, node.b);
+        case ASTKind::UnaryOp:
+            return 1 + CountRecords(file, node.a);
+        case ASTKind::DeclArrayRef:
+        case ASTKind::ConstDecl:
+        case ASTKind::VarDecl:
+        case ASTKind::ArrayDecl:
+            return 1 + CountRecords(file, node.b);
+        case ASTKind::If:
+            return 1 + CountRecords(file, node.a) + countList(node.b, node.c) + countList(node.d, node.e);
+        case ASTKind::While:
+            return 1 + CountRecords(file, node.a) + countList(node.b, node.c);
+        case ASTKind::FunCall:
+            return 1 + countList(node.b, node.c) + countList(node.d, node.e);
+        case ASTKind::For:
+            return 1 + CountRecords(file, node.a) + CountRecords(file, node.b) + CountRecords(file, node.c)
+                   + countList(node.d, node.e);
+        case ASTKind::Program:
+            return 1 + countList(node.b, node.c);
+        default:
+            return 1;
+    }
+}
+
+std::string PrintModule(const llvm::Module& module)
+{
+    std::string text;
+    llvm::raw_string_ostream os(text);
+    module.print(os, nullptr);
+    return os.str();
+}
+
+// The AST file of the parsed program must load into the same AST and generate the same IR
+void CheckASTRoundTrip(const std::string& source, uint64_t astNodes)
+{
+    Parser parser(source);
+    parser.Parse();
+    std::string written = writeASTFile(parser.getProgram());
+
+    ASTFile file;
+    if (!file.open(written))
+        throw std::runtime_error("AST file does not open");
+    if (CountRecords(file, 0) != astNodes || file.getNodeCount() != astNodes)
+        throw std::runtime_error("AST file does not hold every node");
+    std::unique_ptr<ProgramASTNode> loaded = file.materialize();
+    if (writeASTFile(*loaded) != written)
+        throw std::runtime_error("AST file does not round-trip");
+
+    Parser generator(source);
+    generator.setProgram(std::move(loaded));
+    if (PrintModule(generator.Generate()) != PrintModule(parser.Generate()))
+        throw std::runtime_error("loaded AST generates other IR");
+}
+
+using Clock = std::chrono::steady_clock;
+
+double Seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+template <typename Fn>
+double Median(Fn&& run)
+{
+    std::vector<double> samples;
+    for (unsigned i = 0; i < std::max(1u, Repeat.getValue()); i++)
+        samples.push_back(run());
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+// Parses, generates, verifies and prints the IR of `source`, with the statements freed as they are lowered or not
+bool CompileEndToEnd(const std::string& source, bool releaseAST)
+{
+    Parser parser(source);
+    parser.setReleaseAST(releaseAST);
+    if (!parser.Parse())
+        return false;
+    llvm::Module& module = parser.Generate();
+    if (llvm::verifyModule(module, &llvm::errs()))
+        return false;
+    module.print(llvm::nulls(), nullptr);
+    return true;
+}
+
+bool CompilePipelined(const std::string& source)
+{
+    Parser parser(source);
+    if (!parser.ParseAndGenerate())
+        return false;
+    if (llvm::verifyModule(parser.getModule(), &llvm::errs()))
+        return false;
+    parser.getModule().print(llvm::nulls(), nullptr);
+    return true;
+}
+
+// KiB, high-water mark of this process's memory. Unlike ru_maxrss, it starts over at exec and does not
+// count the parent the process was forked from
+long HighWaterRSS()
+{
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> status = llvm::MemoryBuffer::getFileAsStream("/proc/self/status");
+    if (!status)
+        return 0;
+    llvm::StringRef text = (*status)->getBuffer();
+    size_t pos = text.find("VmHWM:");
+    long kib = 0;
+    if (pos == llvm::StringRef::npos || text.substr(pos + 6).ltrim().consumeInteger(10, kib))
+        return 0;
+    return kib;
+}
+
+// Compiles the program in `sourceFile` in a new process of this bench, which starts without the memory of
+// the measurements so far, and returns its peak RSS. Returns 0 when the compilation failed
+long ChildPeakRSS(const std::string& sourceFile, llvm::StringRef mode)
+{
+    llvm::SmallString<128> outputFile;
+    if (llvm::sys::fs::createTemporaryFile("frontend_bench", "rss", outputFile))
+        return 0;
+    std::string modeArg = ("--compile-mode=" + mode).str();
+    std::string sourceArg = "--compile-source=" + sourceFile;
+    std::string scannerArg = "--scanner=" + Scanner;
+    std::vector<llvm::StringRef> argv = {BenchPath, modeArg, sourceArg};
+    if (!Scanner.empty())
+        argv.push_back(scannerArg);
+    llvm::Optional<llvm::StringRef> redirects[] = {llvm::None, llvm::StringRef(outputFile), llvm::None};
+    int status = llvm::sys::ExecuteAndWait(BenchPath, argv, llvm::None, redirects);
+
+    long kib = 0;
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> output = llvm::MemoryBuffer::getFile(outputFile);
+    if (status != 0 || !output || (*output)->getBuffer().trim().getAsInteger(10, kib))
+        kib = 0;
+    llvm::sys::fs::remove(outputFile);
+    return kib;
+}
+
+Result Measure(const GeneratorOptions& options)
+{
+    Result result;
+    result.options = options;
+    std::string source = GenerateProgram(options);
+    result.bytes = source.size();
+
+    result.lexSeconds = Median([&] {
+        Lexer lexer(source);
+        uint64_t tokens = 0;
+        Clock::time_point start = Clock::now();
+        while (lexer.gettok() != tok_eof)
+            tokens++;
+        double seconds = Seconds(start);
+        result.tokens = tokens;
+        return seconds;
+    });
+
+    result.parseSeconds = Median([&] {
+        Parser parser(source);
+        Clock::time_point start = Clock::now();
+        if (!parser.Parse())
+            throw std::runtime_error("generated program does not parse");
+        double seconds = Seconds(start);
+        NodeCounter counter;
+        counter.traverse(&parser.getProgram());
+        result.astNodes = counter.count;
+        return seconds;
+    });
+
+    result.astWriteSeconds = Median([&] {
+        Parser parser(source);
+        parser.Parse();
+        Clock::time_point start = Clock::now();
+        std::string written = writeASTFile(parser.getProgram());
+        double seconds = Seconds(start);
+        result.astBytes = written.size();
+        return seconds;
+    });
+
+    {
+        Parser parser(source);
+        parser.Parse();
+        std::string written = writeASTFile(parser.getProgram());
+        result.astLoadSeconds = Median([&] {
+            Clock::time_point start = Clock::now();
+            ASTFile file;
+            if (!file.open(written) || CountRecords(file, 0) != result.astNodes)
+                throw std::runtime_error("AST file does not load");
+            return Seconds(start);
+        });
+    }
+    CheckASTRoundTrip(source, result.astNodes);
+
+    result.codegenSeconds = Median([&] {
+        Parser parser(source);
+        parser.Parse();
+        Clock::time_point start = Clock::now();
+        llvm::Module& module = parser.Generate();
+        double seconds = Seconds(start);
+        result.instructions = module.getInstructionCount();
+        return seconds;
+    });
+
+    result.endToEndSeconds = Median([&] {
+        Clock::time_point start = Clock::now();
+        if (!CompileEndToEnd(source, true))
+            throw std::runtime_error("generated program does not compile");
+        return Seconds(start);
+    });
+
+    result.pipelinedSeconds = Median([&] {
+        Clock::time_point start = Clock::now();
+        if (!CompilePipelined(source))
+            throw std::runtime_error("generated program does not compile");
+        return Seconds(start);
+    });
+
+    llvm::SmallString<128> sourceFile;
+    int fd;
+    if (llvm::sys::fs::createTemporaryFile("frontend_bench", "mila", fd, sourceFile))
+        throw std::runtime_error("could not create the source file of the memory measurements");
+    {
+        llvm::raw_fd_ostream out(fd, true);
+        out << source;
+    }
+    result.wholeASTRSS = ChildPeakRSS(sourceFile.str().str(), "whole");
+    result.releasedASTRSS = ChildPeakRSS(sourceFile.str().str(), "released");
+    result.pipelinedRSS = ChildPeakRSS(sourceFile.str().str(), "pipelined");
+    llvm::sys::fs::remove(sourceFile);
+    result.peakRSS = CompileStats::peakRSS();
+    return result;
+}
+
+unsigned* Knob(GeneratorOptions& options, llvm::StringRef name)
+{
+    if (name == "statements")
+        return &options.statements;
+    if (name == "expr-depth")
+        return &options.exprDepth;
+    if (name == "identifiers")
+        return &options.identifiers;
+    if (name == "nesting")
+        return &options.nestingDepth;
+    if (name == "array-size")
+        return &options.arraySize;
+    if (name == "literals")
+        return &options.literals;
+    return nullptr;
+}
+
+void PrintTable(llvm::raw_ostream& os, const std::vector<Result>& results)
+{
+    os << "Lexer scanners: " << getCharScanImplementation() << "\n";
+    os << "  stmts depth idents nest array  lit   KiB     tokens  AST nodes  IR instrs"
+          "   Mtok/s  Mnode/s  Minst/s   e2e (ms)  pipe (ms)  RSS (KiB)  whole AST   released  pipelined"
+          "  AST KiB  wr (ms)  load (ms)\n";
+    for (const Result& r : results) {
+        os << llvm::format("%7u %5u %6u %4u %5u %4u %5zu %10llu %10llu %10llu %8.2f %8.2f %8.2f %10.3f %10.3f %10ld %10ld %10ld %10ld %8zu %8.3f %10.3f\n",
+                           r.options.statements, r.options.exprDepth, r.options.identifiers, r.options.nestingDepth, r.options.arraySize, r.options.literals,
+                           r.bytes / 1024, static_cast<unsigned long long>(r.tokens), static_cast<unsigned long long>(r.astNodes),
+                           static_cast<unsigned long long>(r.instructions), r.tokens / r.lexSeconds / 1e6,
+                           r.astNodes / r.parseSeconds / 1e6, r.instructions / r.codegenSeconds / 1e6, r.endToEndSeconds * 1e3, r.pipelinedSeconds * 1e3, r.peakRSS,
+                           r.wholeASTRSS, r.releasedASTRSS, r.pipelinedRSS, r.astBytes / 1024, r.astWriteSeconds * 1e3,
+                           r.astLoadSeconds * 1e3);
+    }
+}
+
+void PrintJSON(llvm::raw_ostream& os, const std::vector<Result>& results)
+{
+    llvm::json::OStream json(os, 2);
+    json.array([&] {
+        for (const Result& r : results) {
+            json.object([&] {
+                json.attributeObject("knobs", [&] {
+                    json.attribute("statements", r.options.statements);
+                    json.attribute("expr_depth", r.options.exprDepth);
+                    json.attribute("identifiers", r.options.identifiers);
+                    json.attribute("nesting", r.options.nestingDepth);
+                    json.attribute("array_size", r.options.arraySize);
+                    json.attribute("literals", r.options.literals);
+                    json.attribute("seed", r.options.seed);
+                });
+                json.attribute("scanner", getCharScanImplementation());
+                json.attribute("bytes", static_cast<int64_t>(r.bytes));
+                json.attribute("tokens", static_cast<int64_t>(r.tokens));
+                json.attribute("ast_nodes", static_cast<int64_t>(r.astNodes));
+                json.attribute("ir_instructions", static_cast<int64_t>(r.instructions));
+                json.attribute("lex_ms", r.lexSeconds * 1e3);
+                json.attribute("parse_ms", r.parseSeconds * 1e3);
+                json.attribute("codegen_ms", r.codegenSeconds * 1e3);
+                json.attribute("end_to_end_ms", r.endToEndSeconds * 1e3);
+                json.attribute("pipelined_ms", r.pipelinedSeconds * 1e3);
+                json.attribute("ast_file_bytes", static_cast<int64_t>(r.astBytes));
+                json.attribute("ast_write_ms", r.astWriteSeconds * 1e3);
+                json.attribute("ast_load_ms", r.astLoadSeconds * 1e3);
+                json.attribute("tokens_per_sec", r.tokens / r.lexSeconds);
+                json.attribute("nodes_per_sec", r.astNodes / r.parseSeconds);
+                json.attribute("instructions_per_sec", r.instructions / r.codegenSeconds);
+                json.attribute("peak_rss_kib", static_cast<int64_t>(r.peakRSS));
+                json.attributeObject("compile_peak_rss_kib", [&] {
+                    json.attribute("whole_ast", static_cast<int64_t>(r.wholeASTRSS));
+                    json.attribute("released_ast", static_cast<int64_t>(r.releasedASTRSS));
+                    json.attribute("pipelined", static_cast<int64_t>(r.pipelinedRSS));
+                });
+            });
+        }
+    });
+    os << "\n";
+}
+}
+
+int main(int argc, char* argv[])
+{
+    llvm::cl::HideUnrelatedOptions(BenchCategory);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "Mila frontend benchmark\n");
+    BenchPath = llvm::sys::fs::getMainExecutable(argv[0], reinterpret_cast<void*>(&HighWaterRSS));
+
+    if (!Scanner.empty() && !setCharScanImplementation(Scanner)) {
+        llvm::errs() << "Scanners '" << Scanner << "' are not available here\n";
+        return 1;
+    }
+
+    if (!CompileMode.empty()) {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = llvm::MemoryBuffer::getFile(CompileSource);
+        if (!buffer)
+            return 1;
+        std::string source = (*buffer)->getBuffer().str();
+        buffer->reset();
+        bool compiled = CompileMode == "pipelined" ? CompilePipelined(source) : CompileEndToEnd(source, CompileMode == "released");
+        if (!compiled)
+            return 1;
+        llvm::outs() << HighWaterRSS() << "\n";
+        return 0;
+    }
+
+    GeneratorOptions base;
+    base.statements = Statements;
+    base.exprDepth = ExprDepth;
+    base.identifiers = Identifiers;
+    base.nestingDepth = Nesting;
+    base.arraySize = ArraySize;
+    base.literals = Literals;
+    base.seed = Seed;
+
+    if (!EmitSource.empty()) {
+        std::error_code ec;
+        llvm::raw_fd_ostream out(EmitSource, ec, llvm::sys::fs::OF_Text);
+        if (ec) {
+            llvm::errs() << "Could not open " << EmitSource << ": " << ec.message() << "\n";
+            return 1;
+        }
+        out << GenerateProgram(base);
+        return 0;
+    }
+
+    std::vector<GeneratorOptions> configs;
+    if (Sweep == "none") {
+        configs.push_back(base);
+    } else {
+        if (Knob(base, Sweep) == nullptr) {
+            llvm::errs() << "Unknown knob '" << Sweep << "'\n";
+            return 1;
+        }
+        std::vector<unsigned> values(Values.begin(), Values.end());
+        if (values.empty() && Sweep == "statements")
+            values = {1000, 2000, 4000, 8000, 16000};
+        if (values.empty())
+            values = {*Knob(base, Sweep)};
+        for (unsigned value : values) {
+            GeneratorOptions options = base;
+            *Knob(options, Sweep) = value;
+            configs.push_back(options);
+        }
+    }
+
+    std::vector<Result> results;
+    try {
+        for (const GeneratorOptions& options : configs)
+            results.push_back(Measure(options));
+    } catch (const std::exception& e) {
+        llvm::errs() << "Benchmark failed: " << e.what() << "\n";
+        return 1;
+    }
+
+    PrintTable(llvm::outs(), results);
+
+    if (!JSONFile.empty()) {
+        std::error_code ec;
+        llvm::raw_fd_ostream out(JSONFile, ec, llvm::sys::fs::OF_Text);
+        if (ec) {
+            llvm::errs() << "Could not open " << JSONFile << ": " << ec.message() << "\n";
+            return 1;
+        }
+        PrintJSON(out, results);
+    }
+    return 0;
+}
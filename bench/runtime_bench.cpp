@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/raw_ostream.h>
+
+/*
+ * Compiles the Mila kernels of bench/kernels at every optimization level, runs each one on its fixed
+ * input and reports the runtime, the instructions retired by the program (perf_event, where the kernel
+ * allows it) and a checksum of the output. Every kernel <name>.mila comes with <name>.in fed to its
+ * standard input and, optionally, <name>.out with the expected output; a different output at any level
+ * fails the run.
+ */
+
+#ifndef MILA_COMPILER
+#define MILA_COMPILER "mila"
+#endif
+#ifndef MILA_KERNELS_DIR
+#define MILA_KERNELS_DIR "bench/kernels"
+#endif
+#ifndef MILA_RUNTIME
+#define MILA_RUNTIME "src/fce.c"
+#endif
+
+static llvm::cl::OptionCategory BenchCategory("Runtime benchmark options");
+
+static llvm::cl::opt<std::string> MilaPath("mila", llvm::cl::desc("Mila compiler"), llvm::cl::value_desc("path"), llvm::cl::init(MILA_COMPILER),
+                                           llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<std::string> CCPath("cc", llvm::cl::desc("C compiler used to link with the runtime"), llvm::cl::value_desc("path"),
+                                         llvm::cl::init("cc"), llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<std::string> Runtime("runtime", llvm::cl::desc("Runtime linked to every kernel, a source file or a library"),
+                                          llvm::cl::value_desc("path"), llvm::cl::init(MILA_RUNTIME), llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<std::string> KernelsDir("kernels", llvm::cl::desc("Directory with <name>.mila, <name>.in and <name>.out"), llvm::cl::value_desc("dir"),
+                                             llvm::cl::init(MILA_KERNELS_DIR), llvm::cl::cat(BenchCategory));
+static llvm::cl::list<std::string> Only("kernel", llvm::cl::desc("Only run these kernels"), llvm::cl::CommaSeparated, llvm::cl::cat(BenchCategory));
+static llvm::cl::list<unsigned> OptLevels("opt-levels", llvm::cl::desc("Optimization levels (default 0,1,2,3)"), llvm::cl::CommaSeparated,
+                                          llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<unsigned> Repeat("repeat", llvm::cl::desc("Runs per kernel and level, the median is reported"), llvm::cl::init(5),
+                                      llvm::cl::cat(BenchCategory));
+static llvm::cl::opt<std::string> JSONFile("json", llvm::cl::desc("Also write the results as JSON to <file>, '-' for stdout"),
+                                           llvm::cl::value_desc("file"), llvm::cl::cat(BenchCategory));
+
+namespace {
+struct Result {
+    std::string kernel;
+    unsigned optLevel = 0;
+    double wall = 0;                // seconds, median
+    double cpu = 0;                 // seconds of user and system time, median
+    int64_t instructions = -1;      // median, -1 when perf_event is not available
+    uint64_t checksum = 0;
+    bool matches = true;            // output equals <name>.out, or the output at the first level
+    std::string error;
+};
+
+struct Run {
+    double wall = 0;
+    double cpu = 0;
+    int64_t instructions = -1;
+    std::string output;
+};
+
+uint64_t FNV1a(llvm::StringRef data)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+int OpenInstructionCounter(pid_t pid)
+{
+    perf_event_attr attr {};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+/*
+ * Runs the program with stdin from the input file. The child waits until the instruction counter is
+ * attached to it, the counter starts at exec, so only the program itself is counted.
+ */
+bool Execute(const std::string& program, const std::string& input, Run& run, std::string& error)
+{
+    int go[2], out[2];
+    if (pipe(go) != 0) {
+        error = "pipe failed";
+        return false;
+    }
+    if (pipe(out) != 0) {
+        close(go[0]);
+        close(go[1]);
+        error = "pipe failed";
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        for (int fd : {go[0], go[1], out[0], out[1]})
+            close(fd);
+        error = "fork failed";
+        return false;
+    }
+    if (pid == 0) {
+        close(go[1]);
+        close(out[0]);
+        int in = open(input.c_str(), O_RDONLY);
+        if (in < 0)
+            _exit(126);
+        dup2(in, STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in);
+        close(out[1]);
+        char c;
+        if (read(go[0], &c, 1) != 1)
+            _exit(126);
+        execl(program.c_str(), program.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+
+    close(go[0]);
+    close(out[1]);
+    int counter = OpenInstructionCounter(pid);
+
+    auto start = std::chrono::steady_clock::now();
+    if (write(go[1], "x", 1) != 1) {
+        // The child is still waiting for the byte, it never runs the program
+        close(go[1]);
+        close(out[0]);
+        if (counter >= 0)
+            close(counter);
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        error = "could not start " + program;
+        return false;
+    }
+    close(go[1]);
+
+    run.output.clear();
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(out[0], buffer, sizeof(buffer))) > 0)
+        run.output.append(buffer, n);
+    close(out[0]);
+
+    int status;
+    rusage usage;
+    wait4(pid, &status, 0, &usage);
+    run.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    run.cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+
+    run.instructions = -1;
+    if (counter >= 0) {
+        uint64_t count;
+        if (read(counter, &count, sizeof(count)) == sizeof(count))
+            run.instructions = static_cast<int64_t>(count);
+        close(counter);
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        error = program + " failed with status " + std::to_string(status);
+        return false;
+    }
+    return true;
+}
+
+bool Tool(const std::string& program, std::vector<std::string> args, std::string& error)
+{
+    args.insert(args.begin(), program);
+    std::vector<llvm::StringRef> argv(args.begin(), args.end());
+    std::string message;
+    int status = llvm::sys::ExecuteAndWait(program, argv, llvm::None, {}, 0, 0, &message);
+    if (status != 0) {
+        error = llvm::sys::path::filename(program).str() + " failed" + (message.empty() ? "" : ": " + message);
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+T Median(std::vector<T> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+Result Measure(llvm::StringRef kernel, unsigned optLevel, llvm::StringRef workDir, const std::string& mila)
+{
+    Result result;
+    result.kernel = kernel.str();
+    result.optLevel = optLevel;
+
+    llvm::SmallString<128> source(KernelsDir.getValue()), input(KernelsDir.getValue());
+    llvm::sys::path::append(source, kernel + ".mila");
+    llvm::sys::path::append(input, kernel + ".in");
+    std::string base = (workDir + "/" + kernel + ".O" + llvm::Twine(optLevel)).str();
+    std::string level = "-O" + std::to_string(optLevel);
+
+    if (!Tool(mila, {source.str().str(), level, "--emit=obj", "-o", base + ".o"}, result.error)
+        || !Tool(CCPath, {base + ".o", Runtime, "-o", base}, result.error))
+        return result;
+
+    std::vector<double> walls, cpus;
+    std::vector<int64_t> instructions;
+    Run run;
+    for (unsigned i = 0; i < std::max(1u, Repeat.getValue()); i++) {
+        if (!Execute(base, input.str().str(), run, result.error))
+            return result;
+        walls.push_back(run.wall);
+        cpus.push_back(run.cpu);
+        instructions.push_back(run.instructions);
+    }
+    result.wall = Median(walls);
+    result.cpu = Median(cpus);
+    result.instructions = Median(instructions);
+    result.checksum = FNV1a(run.output);
+    return result;
+}
+
+void PrintJSON(llvm::raw_ostream& os, const std::vector<Result>& results)
+{
+    llvm::json::OStream json(os, 2);
+    json.array([&] {
+        for (const Result& r : results) {
+            json.object([&] {
+                json.attribute("kernel", r.kernel);
+                json.attribute("opt_level", r.optLevel);
+                if (!r.error.empty()) {
+                    json.attribute("error", r.error);
+                    return;
+                }
+                json.attribute("wall_ms", r.wall * 1e3);
+                json.attribute("cpu_ms", r.cpu * 1e3);
+                if (r.instructions >= 0)
+                    json.attribute("instructions", r.instructions);
+                json.attribute("checksum", llvm::utohexstr(r.checksum));
+                json.attribute("output_ok", r.matches);
+            });
+        }
+    });
+    os << "\n";
+}
+}
+
+int main(int argc, char* argv[])
+{
+    llvm::cl::HideUnrelatedOptions(BenchCategory);
+    llvm::cl::ParseCommandLineOptions(argc, argv, "Mila runtime benchmark\n");
+
+    std::string mila = MilaPath;
+    if (auto found = llvm::sys::findProgramByName(CCPath))
+        CCPath = *found;
+
+    std::vector<std::string> kernels(Only.begin(), Only.end());
+    if (kernels.empty()) {
+        std::error_code ec;
+        for (llvm::sys::fs::directory_iterator it(KernelsDir, ec), end; it != end && !ec; it.increment(ec))
+            if (llvm::sys::path::extension(it->path()) == ".mila")
+                kernels.push_back(llvm::sys::path::stem(it->path()).str());
+        std::sort(kernels.begin(), kernels.end());
+    }
+    if (kernels.empty()) {
+        llvm::errs() << "No kernels found in " << KernelsDir << "\n";
+        return 1;
+    }
+
+    std::vector<unsigned> levels = OptLevels.empty() ? std::vector<unsigned> {0, 1, 2, 3}
+                                                     : std::vector<unsigned>(OptLevels.begin(), OptLevels.end());
+
+    llvm::SmallString<128> tempDir, workDir;
+    llvm::sys::path::system_temp_directory(true, tempDir);
+    llvm::sys::path::append(tempDir, "mila-runtime-bench");
+    if (std::error_code ec = llvm::sys::fs::createUniqueDirectory(tempDir, workDir)) {
+        llvm::errs() << "Could not create a temporary directory: " << ec.message() << "\n";
+        return 1;
+    }
+
+    std::vector<Result> results;
+    bool failed = false;
+    llvm::outs() << "  kernel         level    wall (ms)     cpu (ms)    instructions  checksum          output\n";
+    for (const std::string& kernel : kernels) {
+        llvm::SmallString<128> expectedPath(KernelsDir.getValue());
+        llvm::sys::path::append(expectedPath, kernel + ".out");
+        auto expected = llvm::MemoryBuffer::getFile(expectedPath);
+        llvm::Optional<uint64_t> reference;
+        if (expected)
+            reference = FNV1a((*expected)->getBuffer());
+
+        for (unsigned level : levels) {
+            Result result = Measure(kernel, level, workDir, mila);
+            if (result.error.empty()) {
+                // Without an expected output every level has to agree with the first one
+                if (!reference)
+                    reference = result.checksum;
+                result.matches = result.checksum == *reference;
+            }
+            failed |= !result.error.empty() || !result.matches;
+
+            llvm::outs() << llvm::format("  %-14s -O%-4u", result.kernel.c_str(), level);
+            if (!result.error.empty())
+                llvm::outs() << "error: " << result.error << "\n";
+            else
+                llvm::outs() << llvm::format("%11.2f %12.2f %15s  %016llx  %s\n", result.wall * 1e3, result.cpu * 1e3,
+                                             result.instructions >= 0 ? std::to_string(result.instructions).c_str() : "n/a",
+                                             static_cast<unsigned long long>(result.checksum), result.matches ? "ok" : "MISMATCH");
+            results.push_back(std::move(result));
+        }
+    }
+
+    llvm::sys::fs::remove_directories(workDir);
+
+    if (!JSONFile.empty()) {
+        std::error_code ec;
+        llvm::raw_fd_ostream out(JSONFile, ec, llvm::sys::fs::OF_Text);
+        if (ec) {
+            llvm::errs() << "Could not open " << JSONFile << ": " << ec.message() << "\n";
+            return 1;
+        }
+        PrintJSON(out, results);
+    }
+    return failed ? 1 : 0;
+}
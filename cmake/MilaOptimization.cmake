@@ -0,0 +1,122 @@
+# Link-time and profile-guided optimization of the compiler binary (MILA_LTO, MILA_PGO).
+#
+# Clang gets ThinLTO and instrumentation based PGO (.profraw files merged by llvm-profdata).
+# GCC has no ThinLTO: Thin maps to its parallel partitioned LTO, Full to a single partition;
+# its PGO writes .gcda files into a directory that -fprofile-use reads back.
+
+set(MILA_PGO_RAW_DIR "${CMAKE_BINARY_DIR}/pgo/raw")
+
+if (CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+    set(MILA_CLANG ON)
+elseif (CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+    set(MILA_GCC ON)
+elseif (NOT MILA_LTO STREQUAL "OFF" OR NOT MILA_PGO STREQUAL "OFF")
+    message(FATAL_ERROR "MILA_LTO and MILA_PGO need Clang or GCC, not ${CMAKE_CXX_COMPILER_ID}")
+endif ()
+
+set(MILA_OPT_COMPILE_FLAGS "")
+set(MILA_OPT_LINK_FLAGS "")
+
+if (MILA_LTO STREQUAL "Thin")
+    if (MILA_CLANG)
+        list(APPEND MILA_OPT_COMPILE_FLAGS -flto=thin)
+        list(APPEND MILA_OPT_LINK_FLAGS -flto=thin)
+        find_program(MILA_LLD NAMES ld.lld ld.lld-${LLVM_VERSION_MAJOR})
+        if (MILA_LLD)
+            list(APPEND MILA_OPT_LINK_FLAGS -fuse-ld=lld)
+        endif ()
+    else ()
+        list(APPEND MILA_OPT_COMPILE_FLAGS -flto=auto)
+        list(APPEND MILA_OPT_LINK_FLAGS -flto=auto)
+    endif ()
+elseif (MILA_LTO STREQUAL "Full")
+    if (MILA_CLANG)
+        list(APPEND MILA_OPT_COMPILE_FLAGS -flto=full)
+        list(APPEND MILA_OPT_LINK_FLAGS -flto=full)
+    else ()
+        list(APPEND MILA_OPT_COMPILE_FLAGS -flto -flto-partition=one)
+        list(APPEND MILA_OPT_LINK_FLAGS -flto -flto-partition=one)
+    endif ()
+elseif (NOT MILA_LTO STREQUAL "OFF")
+    message(FATAL_ERROR "MILA_LTO must be OFF, Thin or Full, not '${MILA_LTO}'")
+endif ()
+
+if (MILA_PGO STREQUAL "Generate")
+    if (MILA_CLANG)
+        list(APPEND MILA_OPT_COMPILE_FLAGS -fprofile-instr-generate)
+        list(APPEND MILA_OPT_LINK_FLAGS -fprofile-instr-generate)
+    else ()
+        # The prefix path keeps the .gcda names independent of the build directory
+        list(APPEND MILA_OPT_COMPILE_FLAGS -fprofile-generate=${MILA_PGO_RAW_DIR} -fprofile-update=atomic
+             -fprofile-prefix-path=${CMAKE_BINARY_DIR})
+        list(APPEND MILA_OPT_LINK_FLAGS -fprofile-generate=${MILA_PGO_RAW_DIR})
+    endif ()
+elseif (MILA_PGO STREQUAL "Use")
+    if (NOT EXISTS "${MILA_PGO_PROFILE}")
+        message(FATAL_ERROR "MILA_PGO=Use needs a profile, ${MILA_PGO_PROFILE} does not exist. "
+                "Build with MILA_PGO=Generate and run the mila-pgo-train target first.")
+    endif ()
+    if (MILA_CLANG)
+        list(APPEND MILA_OPT_COMPILE_FLAGS -fprofile-instr-use=${MILA_PGO_PROFILE} -Wno-profile-instr-unprofiled)
+    else ()
+        list(APPEND MILA_OPT_COMPILE_FLAGS -fprofile-use=${MILA_PGO_PROFILE} -fprofile-partial-training
+             -fprofile-prefix-path=${CMAKE_BINARY_DIR} -Wno-missing-profile)
+        list(APPEND MILA_OPT_LINK_FLAGS -fprofile-use=${MILA_PGO_PROFILE})
+    endif ()
+elseif (NOT MILA_PGO STREQUAL "OFF")
+    message(FATAL_ERROR "MILA_PGO must be OFF, Generate or Use, not '${MILA_PGO}'")
+endif ()
+
+# Archives of LTO objects need the compiler's ar wrapper, plain ar would not index their symbols
+if (NOT MILA_LTO STREQUAL "OFF" AND CMAKE_CXX_COMPILER_AR AND CMAKE_CXX_COMPILER_RANLIB)
+    set(CMAKE_AR "${CMAKE_CXX_COMPILER_AR}")
+    set(CMAKE_RANLIB "${CMAKE_CXX_COMPILER_RANLIB}")
+endif ()
+
+# Applies the configured LTO and PGO flags to a target of the compiler. Everything linking a library
+# built this way needs the same link flags (instrumentation runtime, LTO plugin).
+function(mila_optimize target)
+    target_compile_options(${target} PRIVATE ${MILA_OPT_COMPILE_FLAGS})
+    get_target_property(type ${target} TYPE)
+    if (type STREQUAL "STATIC_LIBRARY")
+        target_link_options(${target} INTERFACE ${MILA_OPT_LINK_FLAGS})
+    else ()
+        target_link_options(${target} PRIVATE ${MILA_OPT_LINK_FLAGS})
+    endif ()
+endfunction()
+
+# mila-pgo-train: compiles the training corpus with an instrumented mila and produces MILA_PGO_PROFILE
+function(mila_add_pgo_training)
+    if (NOT MILA_PGO STREQUAL "Generate")
+        return()
+    endif ()
+
+    set(profdata "")
+    if (MILA_CLANG)
+        find_program(MILA_LLVM_PROFDATA NAMES llvm-profdata llvm-profdata-${LLVM_VERSION_MAJOR}
+                     HINTS ${LLVM_TOOLS_BINARY_DIR} REQUIRED)
+        set(profdata ${MILA_LLVM_PROFDATA})
+    endif ()
+
+    set(generator "")
+    set(depends mila)
+    if (TARGET frontend_bench)
+        set(generator $<TARGET_FILE:frontend_bench>)
+        list(APPEND depends frontend_bench)
+    endif ()
+
+    add_custom_target(mila-pgo-train
+        COMMAND ${CMAKE_COMMAND}
+            -DMILA=$<TARGET_FILE:mila>
+            -DGENERATOR=${generator}
+            -DSOURCE_DIR=${PROJECT_SOURCE_DIR}
+            -DWORK_DIR=${CMAKE_BINARY_DIR}/pgo/corpus
+            -DRAW_DIR=${MILA_PGO_RAW_DIR}
+            -DPROFDATA=${profdata}
+            -DPROFILE=${MILA_PGO_PROFILE}
+            -P ${PROJECT_SOURCE_DIR}/cmake/MilaPGOTrain.cmake
+        DEPENDS ${depends}
+        USES_TERMINAL
+        COMMENT "Training mila on the benchmark corpus"
+    )
+endfunction()
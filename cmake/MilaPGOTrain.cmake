@@ -0,0 +1,54 @@
+# Runs an instrumented mila over the training corpus: generated programs of several shapes, the runtime
+# benchmark kernels and the example programs, each at -O0 and -O2. Invoked by the mila-pgo-train target.
+
+file(REMOVE_RECURSE "${WORK_DIR}" "${RAW_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}" "${RAW_DIR}")
+
+set(corpus "")
+
+if (GENERATOR)
+    # statements expr-depth identifiers nesting
+    foreach (shape "4000 3 16 2" "2000 6 64 3" "8000 1 8 1" "1000 4 256 4")
+        separate_arguments(knobs UNIX_COMMAND "${shape}")
+        list(GET knobs 0 statements)
+        list(GET knobs 1 depth)
+        list(GET knobs 2 identifiers)
+        list(GET knobs 3 nesting)
+        set(program "${WORK_DIR}/generated-${statements}-${depth}-${identifiers}-${nesting}.mila")
+        execute_process(COMMAND "${GENERATOR}" --statements=${statements} --expr-depth=${depth}
+                                --identifiers=${identifiers} --nesting=${nesting} --emit-source=${program}
+                        COMMAND_ERROR_IS_FATAL ANY)
+        list(APPEND corpus "${program}")
+    endforeach ()
+endif ()
+
+file(GLOB kernels "${SOURCE_DIR}/bench/kernels/*.mila")
+file(GLOB examples "${SOURCE_DIR}/my tests/*")
+list(APPEND corpus ${kernels} ${examples})
+
+# Clang writes one raw profile per process, GCC accumulates into the .gcda files
+set(ENV{LLVM_PROFILE_FILE} "${RAW_DIR}/mila-%p.profraw")
+
+foreach (program IN LISTS corpus)
+    get_filename_component(name "${program}" NAME_WE)
+    foreach (level 0 2)
+        execute_process(COMMAND "${MILA}" "${program}" -O${level} -o "${WORK_DIR}/${name}.O${level}.ll"
+                        RESULT_VARIABLE result)
+        if (NOT result EQUAL 0)
+            message(FATAL_ERROR "Training compilation of ${program} failed")
+        endif ()
+    endforeach ()
+endforeach ()
+
+if (PROFDATA)
+    file(GLOB raw "${RAW_DIR}/*.profraw")
+    get_filename_component(profile_dir "${PROFILE}" DIRECTORY)
+    file(MAKE_DIRECTORY "${profile_dir}")
+    execute_process(COMMAND "${PROFDATA}" merge -o "${PROFILE}" ${raw} COMMAND_ERROR_IS_FATAL ANY)
+else ()
+    file(REMOVE_RECURSE "${PROFILE}")
+    file(COPY "${RAW_DIR}/" DESTINATION "${PROFILE}")
+endif ()
+
+list(LENGTH corpus count)
+message(STATUS "Trained on ${count} programs, profile written to ${PROFILE}")
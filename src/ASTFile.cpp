@@ -0,0 +1,530 @@
+#include "ASTFile.h"
+
+#include <cstring>
+#include <vector>
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/Casting.h>
+#include <llvm/Support/EndianStream.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+static const char Magic[16] = "mila-ast 2\n";
+static constexpr size_t HeaderSize = 40;
+
+namespace {
+class ASTFileWriter {
+public:
+    std::string write(const ProgramASTNode& program);
+
+private:
+    uint32_t add(const ASTNode* node);
+    template <typename T>
+    uint32_t addList(const std::vector<std::unique_ptr<T>>& nodes);
+    uint32_t intern(llvm::StringRef string);
+
+    std::vector<ASTRecord> m_Nodes;
+    std::vector<uint32_t> m_Children;
+    std::vector<uint32_t> m_Offsets;
+    std::string m_Strings;
+    llvm::StringMap<uint32_t> m_Index;
+};
+}
+
+uint32_t ASTFileWriter::intern(llvm::StringRef string)
+{
+    auto [it, inserted] = m_Index.try_emplace(string, m_Offsets.size());
+    if (inserted) {
+        m_Offsets.push_back(m_Strings.size());
+        m_Strings.append(string.begin(), string.end());
+        m_Strings += '\0';
+    }
+    return it->second;
+}
+
+// The slots of a list are taken before its elements add their own lists, so every list is contiguous.
+// Returns the first slot
+template <typename T>
+uint32_t ASTFileWriter::addList(const std::vector<std::unique_ptr<T>>& nodes)
+{
+    size_t first = m_Children.size();
+    m_Children.resize(first + nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        uint32_t child = add(nodes[i].get());
+        m_Children[first + i] = child;
+    }
+    return first;
+}
+
+uint32_t ASTFileWriter::add(const ASTNode* node)
+{
+    if (node == nullptr)
+        return ASTFile::NoNode;
+
+    uint32_t index = m_Nodes.size();
+    m_Nodes.emplace_back();
+    // Children are added below and grow m_Nodes, the record is only reached through its index
+    auto record = [&]() -> ASTRecord& { return m_Nodes[index]; };
+    memset(&record(), 0, sizeof(ASTRecord));
+    record().kind = static_cast<uint8_t>(node->getKind());
+    record().line = node->getLocation().line;
+    record().column = node->getLocation().column;
+
+    switch (node->getKind()) {
+        case ASTKind::Type:
+            record().op = static_cast<uint8_t>(llvm::cast<TypeASTNode>(node)->getType());
+            break;
+        case ASTKind::BinOp: {
+            auto* binOp = llvm::cast<BinOpASTNode>(node);
+            record().op = static_cast<uint8_t>(-binOp->m_op);
+            uint32_t lhs = add(binOp->m_lhs.get());
+            uint32_t rhs = add(binOp->m_rhs.get());
+            record().a = lhs;
+            record().b = rhs;
+            break;
+        }
+        case ASTKind::UnaryOp: {
+            auto* unaryOp = llvm::cast<UnaryOpASTNode>(node);
+            record().op = static_cast<uint8_t>(-unaryOp->getOp());
+            uint32_t expr = add(unaryOp->getExpr());
+            record().a = expr;
+            break;
+        }
+        case ASTKind::Literal: {
+            uint64_t value = llvm::cast<LiteralASTNode>(node)->getValue();
+            record().a = llvm::Lo_32(value);
+            record().b = llvm::Hi_32(value);
+            break;
+        }
+        case ASTKind::FloatLiteral: {
+            uint64_t bits = llvm::DoubleToBits(llvm::cast<FloatLiteralASTNode>(node)->getValue());
+            record().a = llvm::Lo_32(bits);
+            record().b = llvm::Hi_32(bits);
+            break;
+        }
+        case ASTKind::DeclRef:
+            record().a = intern(llvm::cast<DeclRefASTNode>(node)->m_var);
+            break;
+        case ASTKind::DeclArrayRef: {
+            auto* ref = llvm::cast<DeclArrayRefASTNode>(node);
+            record().a = intern(ref->m_var);
+            uint32_t index = add(ref->m_index.get());
+            record().b = index;
+            break;
+        }
+        case ASTKind::If: {
+            auto* ifNode = llvm::cast<IfASTNode>(node);
+            uint32_t cond = add(ifNode->m_cond.get());
+            record().a = cond;
+            uint32_t bodyTrue = addList(ifNode->m_bodyTrue);
+            record().b = bodyTrue;
+            record().c = ifNode->m_bodyTrue.size();
+            uint32_t bodyFalse = addList(ifNode->m_bodyFalse);
+            record().d = bodyFalse;
+            record().e = ifNode->m_bodyFalse.size();
+            break;
+        }
+        case ASTKind::While: {
+            auto* whileNode = llvm::cast<WhileASTNode>(node);
+            uint32_t cond = add(whileNode->m_cond.get());
+            record().a = cond;
+            uint32_t body = addList(whileNode->m_body);
+            record().b = body;
+            record().c = whileNode->m_body.size();
+            break;
+        }
+        case ASTKind::Break:
+        case ASTKind::Continue:
+            break;
+        case ASTKind::FunCall: {
+            auto* call = llvm::cast<FunCallASTNode>(node);
+            record().a = intern(call->m_func);
+            uint32_t refs = addList(call->m_Refs);
+            record().b = refs;
+            record().c = call->m_Refs.size();
+            uint32_t exprs = addList(call->m_Exprs);
+            record().d = exprs;
+            record().e = call->m_Exprs.size();
+            break;
+        }
+        case ASTKind::ConstDecl: {
+            auto* decl = llvm::cast<ConstDeclASTNode>(node);
+            record().a = intern(decl->m_const);
+            uint32_t expr = add(decl->m_expr.get());
+            record().b = expr;
+            break;
+        }
+        case ASTKind::VarDecl: {
+            auto* decl = llvm::cast<VarDeclASTNode>(node);
+            record().a = intern(decl->m_var);
+            uint32_t type = add(decl->m_type.get());
+            record().b = type;
+            break;
+        }
+        case ASTKind::ArrayDecl: {
+            auto* decl = llvm::cast<ArrayDeclASTNode>(node);
+            record().a = intern(decl->m_var);
+            uint32_t type = add(decl->m_type.get());
+            record().b = type;
+            record().c = static_cast<uint32_t>(decl->m_lowerBound);
+            record().d = static_cast<uint32_t>(decl->m_upperBound);
+            break;
+        }
+        case ASTKind::Assign: {
+            auto* assign = llvm::cast<AssignASTNode>(node);
+            uint32_t var = add(assign->m_var.get());
+            uint32_t expr = add(assign->m_expr.get());
+            record().a = var;
+            record().b = expr;
+            break;
+        }
+        case ASTKind::For: {
+            auto* forNode = llvm::cast<ForASTNode>(node);
+            uint32_t initialization = add(forNode->m_initialization.get());
+            uint32_t condition = add(forNode->m_condition.get());
+            uint32_t increment = add(forNode->m_increment.get());
+            record().a = initialization;
+            record().b = condition;
+            record().c = increment;
+            uint32_t body = addList(forNode->m_body);
+            record().d = body;
+            record().e = forNode->m_body.size();
+            break;
+        }
+        case ASTKind::Program: {
+            auto* program = llvm::cast<ProgramASTNode>(node);
+            record().a = intern(program->nameOfProgram);
+            uint32_t statements = addList(program->m_statements);
+            record().b = statements;
+            record().c = program->m_statements.size();
+            record().d = program->m_endLoc.line;
+            record().e = program->m_endLoc.column;
+            break;
+        }
+    }
+    return index;
+}
+
+std::string ASTFileWriter::write(const ProgramASTNode& program)
+{
+    add(&program);
+    m_Offsets.push_back(m_Strings.size());
+
+    std::string body;
+    llvm::raw_string_ostream bodyOS(body);
+    llvm::support::endian::Writer bodyWriter(bodyOS, llvm::support::little);
+    bodyOS.write(reinterpret_cast<const char*>(m_Nodes.data()), m_Nodes.size() * sizeof(ASTRecord));
+    for (uint32_t child : m_Children)
+        bodyWriter.write<uint32_t>(child);
+    for (uint32_t offset : m_Offsets)
+        bodyWriter.write<uint32_t>(offset);
+    bodyOS << m_Strings;
+    bodyOS.flush();
+
+    std::string file;
+    file.reserve(HeaderSize + body.size());
+    llvm::raw_string_ostream os(file);
+    os.write(Magic, sizeof(Magic));
+    llvm::support::endian::Writer writer(os, llvm::support::little);
+    writer.write<uint32_t>(m_Nodes.size());
+    writer.write<uint32_t>(m_Children.size());
+    writer.write<uint32_t>(m_Offsets.size() - 1);
+    writer.write<uint32_t>(m_Strings.size());
+    writer.write<uint64_t>(llvm::xxHash64(body));
+    os << body;
+    os.flush();
+    return file;
+}
+
+std::string writeASTFile(const ProgramASTNode& program)
+{
+    return ASTFileWriter().write(program);
+}
+
+
+bool ASTFile::open(llvm::StringRef data)
+{
+    using namespace llvm::support::endian;
+
+    if (data.size() < HeaderSize || memcmp(data.data(), Magic, sizeof(Magic)) != 0)
+        return false;
+    const char* header = data.data() + sizeof(Magic);
+    uint64_t nodeCount = read32le(header);
+    uint64_t childCount = read32le(header + 4);
+    uint64_t stringCount = read32le(header + 8);
+    uint64_t stringBytes = read32le(header + 12);
+    if (HeaderSize + nodeCount * sizeof(ASTRecord) + childCount * 4 + (stringCount + 1) * 4 + stringBytes != data.size())
+        return false;
+    if (llvm::xxHash64(data.drop_front(HeaderSize)) != read64le(header + 16))
+        return false;
+
+    m_Nodes = reinterpret_cast<const ASTRecord*>(data.data() + HeaderSize);
+    m_Children = reinterpret_cast<const llvm::support::ulittle32_t*>(m_Nodes + nodeCount);
+    m_Offsets = m_Children + childCount;
+    m_Strings = reinterpret_cast<const char*>(m_Offsets + stringCount + 1);
+    m_NodeCount = nodeCount;
+    m_ChildCount = childCount;
+    m_StringCount = stringCount;
+    m_StringBytes = stringBytes;
+    if (!check()) {
+        m_NodeCount = 0;
+        return false;
+    }
+    return true;
+}
+
+llvm::StringRef ASTFile::getString(uint32_t index) const
+{
+    return {m_Strings + m_Offsets[index], m_Offsets[index + 1] - m_Offsets[index] - 1};
+}
+
+static bool IsType(ASTKind kind) { return kind == ASTKind::Type; }
+static bool IsExpr(ASTKind kind) { return kind >= ASTKind::BinOp && kind <= ASTKind::DeclArrayRef; }
+static bool IsVar(ASTKind kind) { return kind >= ASTKind::DeclRef && kind <= ASTKind::DeclArrayRef; }
+static bool IsStatement(ASTKind kind) { return kind >= ASTKind::If && kind <= ASTKind::For; }
+static bool IsAssign(ASTKind kind) { return kind == ASTKind::Assign; }
+
+static bool IsBinaryOperator(Token op)
+{
+    switch (op) {
+        case Token::tok_sum:
+        case Token::tok_substract:
+        case Token::tok_multiply:
+        case Token::tok_mod:
+        case Token::tok_div:
+        case Token::tok_greater:
+        case Token::tok_less:
+        case Token::tok_greaterequal:
+        case Token::tok_lessequal:
+        case Token::tok_notequal:
+        case Token::tok_xor:
+        case Token::tok_and:
+        case Token::tok_or:
+        case Token::tok_equal:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool IsRuntimeFunction(llvm::StringRef name)
+{
+    return name == "write" || name == "writeln" || name == "readln";
+}
+
+// Children come after their parent and every node but the program is the child of exactly one other,
+// so the nodes are a tree and materialize ends. Every child is present, as in a parsed program
+bool ASTFile::checkChild(uint32_t parent, uint32_t child, bool (*kindOf)(ASTKind), std::vector<bool>& seen) const
+{
+    if (child <= parent || child >= m_NodeCount || seen[child] || !kindOf(m_Nodes[child].getKind()))
+        return false;
+    seen[child] = true;
+    return true;
+}
+
+bool ASTFile::checkList(uint32_t parent, uint32_t first, uint32_t count, bool (*kindOf)(ASTKind), std::vector<bool>& seen) const
+{
+    if (first > m_ChildCount || count > m_ChildCount - first)
+        return false;
+    for (uint32_t child : getList(first, count)) {
+        if (!checkChild(parent, child, kindOf, seen))
+            return false;
+    }
+    return true;
+}
+
+bool ASTFile::check()
+{
+    uint32_t previous = 0;
+    for (uint32_t i = 0; i <= m_StringCount; i++) {
+        uint32_t offset = m_Offsets[i];
+        if (offset < previous || offset > m_StringBytes || (i > 0 && (offset == previous || m_Strings[offset - 1] != '\0')))
+            return false;
+        previous = offset;
+    }
+    if (m_Offsets[0] != 0 || previous != m_StringBytes)
+        return false;
+
+    if (m_NodeCount == 0 || getRoot().getKind() != ASTKind::Program)
+        return false;
+    std::vector<bool> seen(m_NodeCount);
+    seen[0] = true;
+
+    for (uint32_t i = 0; i < m_NodeCount; i++) {
+        const ASTRecord& node = m_Nodes[i];
+        bool valid;
+        switch (node.getKind()) {
+            case ASTKind::Type:
+                valid = node.op == static_cast<uint8_t>(Type::INT) || node.op == static_cast<uint8_t>(Type::DOUBLE);
+                break;
+            case ASTKind::BinOp:
+                valid = IsBinaryOperator(static_cast<Token>(-node.op)) && checkChild(i, node.a, IsExpr, seen)
+                        && checkChild(i, node.b, IsExpr, seen);
+                break;
+            case ASTKind::UnaryOp:
+                valid = static_cast<Token>(-node.op) == Token::tok_not && checkChild(i, node.a, IsExpr, seen);
+                break;
+            case ASTKind::Literal:
+            case ASTKind::FloatLiteral:
+            case ASTKind::Break:
+            case ASTKind::Continue:
+                valid = true;
+                break;
+            case ASTKind::DeclRef:
+                valid = checkName(node.a);
+                break;
+            case ASTKind::DeclArrayRef:
+                valid = checkName(node.a) && checkChild(i, node.b, IsExpr, seen);
+                break;
+            case ASTKind::If:
+                valid = checkChild(i, node.a, IsExpr, seen) && checkList(i, node.b, node.c, IsStatement, seen)
+                        && checkList(i, node.d, node.e, IsStatement, seen);
+                break;
+            case ASTKind::While:
+                valid = checkChild(i, node.a, IsExpr, seen) && checkList(i, node.b, node.c, IsStatement, seen);
+                break;
+            case ASTKind::FunCall:
+                // The runtime functions are the only ones there are
+                valid = checkName(node.a) && IsRuntimeFunction(getString(node.a))
+                        && checkList(i, node.b, node.c, IsVar, seen) && checkList(i, node.d, node.e, IsExpr, seen);
+                break;
+            case ASTKind::ConstDecl:
+                valid = checkName(node.a) && checkChild(i, node.b, IsExpr, seen);
+                break;
+            case ASTKind::VarDecl:
+            case ASTKind::ArrayDecl:
+                valid = checkName(node.a) && checkChild(i, node.b, IsType, seen);
+                break;
+            case ASTKind::Assign:
+                valid = checkChild(i, node.a, IsVar, seen) && checkChild(i, node.b, IsExpr, seen);
+                break;
+            case ASTKind::For:
+                valid = checkChild(i, node.a, IsAssign, seen) && checkChild(i, node.b, IsExpr, seen)
+                        && checkChild(i, node.c, IsAssign, seen) && checkList(i, node.d, node.e, IsStatement, seen);
+                break;
+            case ASTKind::Program:
+                valid = i == 0 && checkName(node.a) && checkList(i, node.b, node.c, IsStatement, seen);
+                break;
+            default:
+                valid = false;
+                break;
+        }
+        if (!valid)
+            return false;
+    }
+    return llvm::all_of(seen, [](bool reached) { return reached; });
+}
+
+
+namespace {
+class Materializer {
+public:
+    explicit Materializer(const ASTFile& file)
+            : m_File(file) {}
+
+    template <typename T>
+    std::unique_ptr<T> get(uint32_t index)
+    {
+        // open() checked that every child is there and of the right kind
+        return std::unique_ptr<T>(llvm::cast<T>(make(m_File.getNode(index)).release()));
+    }
+
+    template <typename T>
+    std::vector<std::unique_ptr<T>> getList(uint32_t first, uint32_t count)
+    {
+        std::vector<std::unique_ptr<T>> nodes;
+        nodes.reserve(count);
+        for (uint32_t child : m_File.getList(first, count))
+            nodes.push_back(get<T>(child));
+        return nodes;
+    }
+
+    std::unique_ptr<ASTNode> make(const ASTRecord& record);
+
+private:
+    const ASTFile& m_File;
+};
+}
+
+std::unique_ptr<ASTNode> Materializer::make(const ASTRecord& record)
+{
+    std::unique_ptr<ASTNode> node;
+    switch (record.getKind()) {
+        case ASTKind::Type:
+            node = std::make_unique<TypeASTNode>(static_cast<Type>(record.op));
+            break;
+        case ASTKind::BinOp:
+            node = std::make_unique<BinOpASTNode>(static_cast<Token>(-record.op), get<ExprASTNode>(record.a),
+                                                  get<ExprASTNode>(record.b));
+            break;
+        case ASTKind::UnaryOp:
+            node = std::make_unique<UnaryOpASTNode>(static_cast<Token>(-record.op), get<ExprASTNode>(record.a));
+            break;
+        case ASTKind::Literal:
+            node = std::make_unique<LiteralASTNode>(static_cast<int64_t>(llvm::Make_64(record.b, record.a)));
+            break;
+        case ASTKind::FloatLiteral:
+            node = std::make_unique<FloatLiteralASTNode>(llvm::BitsToDouble(llvm::Make_64(record.b, record.a)));
+            break;
+        case ASTKind::DeclRef:
+            node = std::make_unique<DeclRefASTNode>(m_File.getString(record.a).str());
+            break;
+        case ASTKind::DeclArrayRef:
+            node = std::make_unique<DeclArrayRefASTNode>(m_File.getString(record.a).str(), get<ExprASTNode>(record.b));
+            break;
+        case ASTKind::If: {
+            auto ifNode = std::make_unique<IfASTNode>(get<ExprASTNode>(record.a), getList<StatementASTNode>(record.b, record.c));
+            ifNode->m_bodyFalse = getList<StatementASTNode>(record.d, record.e);
+            node = std::move(ifNode);
+            break;
+        }
+        case ASTKind::While:
+            node = std::make_unique<WhileASTNode>(get<ExprASTNode>(record.a), getList<StatementASTNode>(record.b, record.c));
+            break;
+        case ASTKind::Break:
+            node = std::make_unique<BreakASTNode>();
+            break;
+        case ASTKind::Continue:
+            node = std::make_unique<ContinueASTNode>();
+            break;
+        case ASTKind::FunCall: {
+            auto call = std::make_unique<FunCallASTNode>(m_File.getString(record.a).str(), getList<VarASTNode>(record.b, record.c));
+            call->m_Exprs = getList<ExprASTNode>(record.d, record.e);
+            node = std::move(call);
+            break;
+        }
+        case ASTKind::ConstDecl:
+            node = std::make_unique<ConstDeclASTNode>(m_File.getString(record.a).str(), get<ExprASTNode>(record.b));
+            break;
+        case ASTKind::VarDecl:
+            node = std::make_unique<VarDeclASTNode>(m_File.getString(record.a).str(), get<TypeASTNode>(record.b));
+            break;
+        case ASTKind::ArrayDecl:
+            node = std::make_unique<ArrayDeclASTNode>(m_File.getString(record.a).str(), get<TypeASTNode>(record.b),
+                                                      static_cast<int>(record.c), static_cast<int>(record.d));
+            break;
+        case ASTKind::Assign:
+            node = std::make_unique<AssignASTNode>(get<VarASTNode>(record.a), get<ExprASTNode>(record.b));
+            break;
+        case ASTKind::For:
+            node = std::make_unique<ForASTNode>(get<AssignASTNode>(record.a), get<ExprASTNode>(record.b),
+                                                get<AssignASTNode>(record.c), getList<StatementASTNode>(record.d, record.e));
+            break;
+        case ASTKind::Program: {
+            auto program = std::make_unique<ProgramASTNode>(getList<StatementASTNode>(record.b, record.c));
+            program->nameOfProgram = m_File.getString(record.a).str();
+            program->m_endLoc = {record.d, record.e};
+            node = std::move(program);
+            break;
+        }
+    }
+    node->setLocation(record.getLocation());
+    return node;
+}
+
+std::unique_ptr<ProgramASTNode> ASTFile::materialize() const
+{
+    assert(m_NodeCount != 0 && "materialize needs an opened file");
+    return std::unique_ptr<ProgramASTNode>(llvm::cast<ProgramASTNode>(Materializer(*this).make(getRoot()).release()));
+}
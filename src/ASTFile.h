@@ -0,0 +1,104 @@
+#ifndef PJPPROJECT_ASTFILE_HPP
+#define PJPPROJECT_ASTFILE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Endian.h>
+
+#include "ast.h"
+
+/*
+ * The AST of a program in a binary file that is used in place: the nodes are records of one size in
+ * a flat array, they refer to each other by index, so the file can be memory-mapped anywhere and
+ * walked without allocating. All numbers are little endian, records have no alignment requirement:
+ *
+ *   header     "mila-ast 2\n" padded to 16 bytes, uint32 number of nodes, of child indexes, of strings
+ *              and string bytes, uint64 xxHash64 of the rest of the file
+ *   nodes      ASTRecord of every node in pre-order, the program first
+ *   children   uint32 node indexes, the statement and argument lists point into them
+ *   offsets    uint32 offset of every string, and one past the last string
+ *   strings    names, each once and NUL-terminated
+ *
+ * The fields of a record depending on its kind; a name is a string index, a list a first index into
+ * the children and a count. A file that opens has every child, NoNode is only written for a missing one:
+ *
+ *   Type          op: Type
+ *   BinOp         op: -Token, a: lhs, b: rhs
+ *   UnaryOp       op: -Token, a: expression
+ *   Literal       a, b: low and high half of the value
+ *   FloatLiteral  a, b: low and high half of the bits of the double
+ *   DeclRef       a: name
+ *   DeclArrayRef  a: name, b: index as written, from the lower bound of the array
+ *   If            a: condition, b, c: true branch list, d, e: false branch list
+ *   While         a: condition, b, c: body list
+ *   FunCall       a: name, b, c: references list (readln), d, e: expressions list
+ *   ConstDecl     a: name, b: expression
+ *   VarDecl       a: name, b: type
+ *   ArrayDecl     a: name, b: type, c: lower bound, d: upper bound
+ *   Assign        a: variable, b: expression
+ *   For           a: initialization, b: condition, c: increment, d, e: body list
+ *   Program       a: name, b, c: statements list, d, e: line and column of the final 'end'
+ */
+
+struct ASTRecord {
+    uint8_t kind;                       // ASTKind
+    uint8_t op;
+    uint8_t reserved[2];
+    llvm::support::ulittle32_t line;
+    llvm::support::ulittle32_t column;
+    llvm::support::ulittle32_t a, b, c, d, e;
+
+    ASTKind getKind() const { return static_cast<ASTKind>(kind); }
+    SourceLocation getLocation() const { return {line, column}; }
+};
+static_assert(sizeof(ASTRecord) == 32, "records are packed");
+
+// The file of a parsed program; it keeps every statement, not after Generate has released them
+std::string writeASTFile(const ProgramASTNode& program);
+
+// A file written by writeASTFile, read in place; the data must outlive the ASTFile
+class ASTFile {
+public:
+    static constexpr uint32_t NoNode = UINT32_MAX;
+
+    // True when data starts like an AST file of any version, so it is not taken for Mila source
+    static bool isASTFile(llvm::StringRef data) { return data.startswith("mila-ast "); }
+
+    // False when data is not an AST file or it is damaged: every index, list and string of an opened
+    // file is in range and the nodes form one tree of the shape the parser builds
+    bool open(llvm::StringRef data);
+
+    uint32_t getNodeCount() const { return m_NodeCount; }
+    const ASTRecord& getNode(uint32_t index) const { return m_Nodes[index]; }
+    // The program, node 0
+    const ASTRecord& getRoot() const { return m_Nodes[0]; }
+    llvm::ArrayRef<llvm::support::ulittle32_t> getList(uint32_t first, uint32_t count) const
+    {
+        return {m_Children + first, count};
+    }
+    llvm::StringRef getString(uint32_t index) const;
+
+    // The tree the parser built, for codegen; unlike walking the records this allocates every node
+    std::unique_ptr<ProgramASTNode> materialize() const;
+
+private:
+    bool check();
+    bool checkChild(uint32_t parent, uint32_t child, bool (*kindOf)(ASTKind), std::vector<bool>& seen) const;
+    bool checkList(uint32_t parent, uint32_t first, uint32_t count, bool (*kindOf)(ASTKind), std::vector<bool>& seen) const;
+    bool checkName(uint32_t index) const { return index < m_StringCount; }
+
+    const ASTRecord* m_Nodes = nullptr;
+    const llvm::support::ulittle32_t* m_Children = nullptr;
+    const llvm::support::ulittle32_t* m_Offsets = nullptr;
+    const char* m_Strings = nullptr;
+    uint32_t m_NodeCount = 0;
+    uint32_t m_ChildCount = 0;
+    uint32_t m_StringCount = 0;
+    uint32_t m_StringBytes = 0;
+};
+
+#endif //PJPPROJECT_ASTFILE_HPP
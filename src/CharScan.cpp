@@ -0,0 +1,264 @@
+#include "CharScan.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MILA_CHARSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static constexpr uint8_t Classify(unsigned c)
+{
+    if (c == ' ' || (c >= '\t' && c <= '\r'))
+        return CharSpace;
+    if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'))
+        return CharAlpha;
+    if (c >= '0' && c <= '9')
+        return CharDigit;
+    return 0;
+}
+
+const uint8_t CharClasses[256] = {
+#define ROW(base) Classify(base + 0), Classify(base + 1), Classify(base + 2), Classify(base + 3), \
+                  Classify(base + 4), Classify(base + 5), Classify(base + 6), Classify(base + 7), \
+                  Classify(base + 8), Classify(base + 9), Classify(base + 10), Classify(base + 11), \
+                  Classify(base + 12), Classify(base + 13), Classify(base + 14), Classify(base + 15)
+    ROW(0x00), ROW(0x10), ROW(0x20), ROW(0x30), ROW(0x40), ROW(0x50), ROW(0x60), ROW(0x70),
+    ROW(0x80), ROW(0x90), ROW(0xA0), ROW(0xB0), ROW(0xC0), ROW(0xD0), ROW(0xE0), ROW(0xF0),
+#undef ROW
+};
+
+
+// Byte by byte, for the tail of the source and where there are no vector scanners
+
+static const char* ScanSpaceScalar(const char* cur, const char* end, Newlines& newlines)
+{
+    for (; cur != end && isSpaceChar(*cur); cur++) {
+        if (*cur == '\n') {
+            newlines.count++;
+            newlines.last = cur;
+        }
+    }
+    return cur;
+}
+
+static const char* ScanAlnumScalar(const char* cur, const char* end)
+{
+    while (cur != end && isAlnumChar(*cur))
+        cur++;
+    return cur;
+}
+
+static const char* ScanDigitsScalar(const char* cur, const char* end)
+{
+    while (cur != end && isDigitChar(*cur))
+        cur++;
+    return cur;
+}
+
+#ifdef MILA_CHARSCAN_X86
+
+/*
+ * A block of 16 or 32 bytes is classified with compares into a bit mask, one bit per byte.
+ * The run ends at the lowest byte outside the class; the bytes are signed in the compares,
+ * so everything from 0x80 up is below every range and in no class.
+ */
+
+// Counts the '\n' below the first `length` bytes of a block
+static inline void CountNewlines(const char* block, uint32_t newlineMask, unsigned length, Newlines& newlines)
+{
+    if (length < 32)
+        newlineMask &= (1u << length) - 1;
+    if (newlineMask == 0)
+        return;
+    newlines.count += __builtin_popcount(newlineMask);
+    newlines.last = block + 31 - __builtin_clz(newlineMask);
+}
+
+static inline uint32_t SpaceMaskSSE2(__m128i bytes)
+{
+    __m128i space = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    __m128i control = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8('\r' + 1)));
+    return _mm_movemask_epi8(_mm_or_si128(space, control));
+}
+
+static inline uint32_t AlnumMaskSSE2(__m128i bytes)
+{
+    // Setting bit 5 maps upper case onto lower case and nothing else onto a letter
+    __m128i lower = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1)));
+    return _mm_movemask_epi8(_mm_or_si128(alpha, digit));
+}
+
+static inline uint32_t DigitMaskSSE2(__m128i bytes)
+{
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1)));
+    return _mm_movemask_epi8(digit);
+}
+
+static const char* ScanSpaceSSE2(const char* cur, const char* end, Newlines& newlines)
+{
+    for (; end - cur >= 16; cur += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur));
+        uint32_t outside = ~SpaceMaskSSE2(bytes) & 0xFFFF;
+        uint32_t newline = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+        if (outside != 0) {
+            unsigned length = __builtin_ctz(outside);
+            CountNewlines(cur, newline, length, newlines);
+            return cur + length;
+        }
+        CountNewlines(cur, newline, 16, newlines);
+    }
+    return ScanSpaceScalar(cur, end, newlines);
+}
+
+static const char* ScanAlnumSSE2(const char* cur, const char* end)
+{
+    for (; end - cur >= 16; cur += 16) {
+        uint32_t outside = ~AlnumMaskSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cur))) & 0xFFFF;
+        if (outside != 0)
+            return cur + __builtin_ctz(outside);
+    }
+    return ScanAlnumScalar(cur, end);
+}
+
+static const char* ScanDigitsSSE2(const char* cur, const char* end)
+{
+    for (; end - cur >= 16; cur += 16) {
+        uint32_t outside = ~DigitMaskSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cur))) & 0xFFFF;
+        if (outside != 0)
+            return cur + __builtin_ctz(outside);
+    }
+    return ScanDigitsScalar(cur, end);
+}
+
+#define MILA_AVX2 __attribute__((target("avx2")))
+
+MILA_AVX2 static inline uint32_t SpaceMaskAVX2(__m256i bytes)
+{
+    __m256i space = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+    __m256i control = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('\t' - 1)),
+                                       _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), bytes));
+    return _mm256_movemask_epi8(_mm256_or_si256(space, control));
+}
+
+MILA_AVX2 static inline uint32_t AlnumMaskAVX2(__m256i bytes)
+{
+    __m256i lower = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+    __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('0' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), bytes));
+    return _mm256_movemask_epi8(_mm256_or_si256(alpha, digit));
+}
+
+MILA_AVX2 static inline uint32_t DigitMaskAVX2(__m256i bytes)
+{
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('0' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), bytes));
+    return _mm256_movemask_epi8(digit);
+}
+
+MILA_AVX2 static const char* ScanSpaceAVX2(const char* cur, const char* end, Newlines& newlines)
+{
+    for (; end - cur >= 32; cur += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cur));
+        uint32_t outside = ~SpaceMaskAVX2(bytes);
+        uint32_t newline = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+        if (outside != 0) {
+            unsigned length = __builtin_ctz(outside);
+            CountNewlines(cur, newline, length, newlines);
+            return cur + length;
+        }
+        CountNewlines(cur, newline, 32, newlines);
+    }
+    return ScanSpaceSSE2(cur, end, newlines);
+}
+
+MILA_AVX2 static const char* ScanAlnumAVX2(const char* cur, const char* end)
+{
+    for (; end - cur >= 32; cur += 32) {
+        uint32_t outside = ~AlnumMaskAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(cur)));
+        if (outside != 0)
+            return cur + __builtin_ctz(outside);
+    }
+    return ScanAlnumSSE2(cur, end);
+}
+
+MILA_AVX2 static const char* ScanDigitsAVX2(const char* cur, const char* end)
+{
+    for (; end - cur >= 32; cur += 32) {
+        uint32_t outside = ~DigitMaskAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(cur)));
+        if (outside != 0)
+            return cur + __builtin_ctz(outside);
+    }
+    return ScanDigitsSSE2(cur, end);
+}
+
+#endif
+
+
+namespace {
+struct Scanners {
+    const char* name;
+    const char* (*space)(const char*, const char*, Newlines&);
+    const char* (*alnum)(const char*, const char*);
+    const char* (*digits)(const char*, const char*);
+};
+}
+
+static const Scanners ScalarScanners {"scalar", ScanSpaceScalar, ScanAlnumScalar, ScanDigitsScalar};
+#ifdef MILA_CHARSCAN_X86
+static const Scanners SSE2Scanners {"sse2", ScanSpaceSSE2, ScanAlnumSSE2, ScanDigitsSSE2};
+static const Scanners AVX2Scanners {"avx2", ScanSpaceAVX2, ScanAlnumAVX2, ScanDigitsAVX2};
+#endif
+
+static const Scanners* BestScanners()
+{
+#ifdef MILA_CHARSCAN_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? &AVX2Scanners : &SSE2Scanners;
+#else
+    return &ScalarScanners;
+#endif
+}
+
+static const Scanners* ActiveScanners = BestScanners();
+
+const char* scanLongSpace(const char* cur, const char* end, Newlines& newlines)
+{
+    return ActiveScanners->space(cur, end, newlines);
+}
+
+const char* scanLongAlnum(const char* cur, const char* end)
+{
+    return ActiveScanners->alnum(cur, end);
+}
+
+const char* scanLongDigits(const char* cur, const char* end)
+{
+    return ActiveScanners->digits(cur, end);
+}
+
+const char* getCharScanImplementation()
+{
+    return ActiveScanners->name;
+}
+
+bool setCharScanImplementation(llvm::StringRef name)
+{
+    if (name == "scalar") {
+        ActiveScanners = &ScalarScanners;
+        return true;
+    }
+#ifdef MILA_CHARSCAN_X86
+    if (name == "sse2") {
+        ActiveScanners = &SSE2Scanners;
+        return true;
+    }
+    if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+        ActiveScanners = &AVX2Scanners;
+        return true;
+    }
+#endif
+    return false;
+}
@@ -0,0 +1,89 @@
+#ifndef PJPPROJECT_CHARSCAN_HPP
+#define PJPPROJECT_CHARSCAN_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include <llvm/ADT/StringRef.h>
+
+/*
+ * Character classes of the lexer and scanners that skip a run of one class 16 or 32 bytes at a time.
+ * The classes are those of the "C" locale whatever locale the compiler runs in:
+ *
+ *   space   ' ' \t \n \v \f \r
+ *   alpha   A-Z a-z
+ *   digit   0-9
+ *
+ * The first bytes of a run are classified inline with a table. Longer runs go on in the SSE2 scanners,
+ * which run on every x86-64 CPU, or the AVX2 ones, picked at startup when the CPU has AVX2. Elsewhere,
+ * and for the last bytes of the source, they are scanned byte by byte.
+ */
+
+enum CharClass : uint8_t {
+    CharSpace = 1,
+    CharAlpha = 2,
+    CharDigit = 4
+};
+
+extern const uint8_t CharClasses[256];
+
+inline bool isSpaceChar(char c) { return CharClasses[static_cast<unsigned char>(c)] & CharSpace; }
+inline bool isAlphaChar(char c) { return CharClasses[static_cast<unsigned char>(c)] & CharAlpha; }
+inline bool isDigitChar(char c) { return CharClasses[static_cast<unsigned char>(c)] & CharDigit; }
+inline bool isAlnumChar(char c) { return CharClasses[static_cast<unsigned char>(c)] & (CharAlpha | CharDigit); }
+
+// Line breaks passed by scanSpace
+struct Newlines {
+    unsigned count = 0;
+    const char* last = nullptr;         // the last '\n' passed
+};
+
+// The scanners picked at startup, for the rest of a run longer than ShortRun bytes
+const char* scanLongSpace(const char* cur, const char* end, Newlines& newlines);
+const char* scanLongAlnum(const char* cur, const char* end);
+const char* scanLongDigits(const char* cur, const char* end);
+
+// Most runs are a few bytes, over before a vector load would pay off; they are scanned inline
+constexpr ptrdiff_t ShortRun = 8;
+
+// First character from `cur` on that is not a space, or `end`
+inline const char* scanSpace(const char* cur, const char* end, Newlines& newlines)
+{
+    for (const char* stop = cur + std::min(end - cur, ShortRun); cur != stop; cur++) {
+        if (!isSpaceChar(*cur))
+            return cur;
+        if (*cur == '\n') {
+            newlines.count++;
+            newlines.last = cur;
+        }
+    }
+    return cur == end ? cur : scanLongSpace(cur, end, newlines);
+}
+
+// First character from `cur` on that is neither a letter nor a digit, or `end`
+inline const char* scanAlnum(const char* cur, const char* end)
+{
+    for (const char* stop = cur + std::min(end - cur, ShortRun); cur != stop; cur++) {
+        if (!isAlnumChar(*cur))
+            return cur;
+    }
+    return cur == end ? cur : scanLongAlnum(cur, end);
+}
+
+// First character from `cur` on that is not a digit, or `end`
+inline const char* scanDigits(const char* cur, const char* end)
+{
+    for (const char* stop = cur + std::min(end - cur, ShortRun); cur != stop; cur++) {
+        if (!isDigitChar(*cur))
+            return cur;
+    }
+    return cur == end ? cur : scanLongDigits(cur, end);
+}
+
+// The scanners in use: "avx2", "sse2" or "scalar"
+const char* getCharScanImplementation();
+// Switches to other scanners, for benchmarks; false when this CPU or build does not have them
+bool setCharScanImplementation(llvm::StringRef name);
+
+#endif //PJPPROJECT_CHARSCAN_HPP
@@ -0,0 +1,75 @@
+#include "DebugInfo.h"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/BinaryFormat/Dwarf.h>
+#include <llvm/IR/DebugInfoMetadata.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
+DebugInfo::DebugInfo(llvm::Module& module, llvm::StringRef sourceName, bool optimized)
+        : m_builder(module), m_optimized(optimized)
+{
+    // Debuggers look the source up as <directory>/<file>, a relative name is taken from the working directory
+    llvm::SmallString<128> path(sourceName == "-" ? "<stdin>" : sourceName);
+    if (sourceName != "-")
+        llvm::sys::fs::make_absolute(path);
+    m_file = m_builder.createFile(llvm::sys::path::filename(path), llvm::sys::path::parent_path(path));
+
+    m_builder.createCompileUnit(llvm::dwarf::DW_LANG_Pascal83, m_file, "mila", optimized, "", 0);
+
+    module.addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+    module.addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+}
+
+void DebugInfo::enterFunction(llvm::Function& function, SourceLocation loc)
+{
+    llvm::DISubroutineType* type = m_builder.createSubroutineType(
+            m_builder.getOrCreateTypeArray({getType(function.getReturnType(), 0)}));
+
+    llvm::DISubprogram::DISPFlags flags = llvm::DISubprogram::SPFlagDefinition;
+    if (m_optimized)
+        flags |= llvm::DISubprogram::SPFlagOptimized;
+
+    m_function = m_builder.createFunction(m_file, function.getName(), "", m_file, loc.line, type, loc.line,
+                                          llvm::DINode::FlagPrototyped, flags);
+    function.setSubprogram(m_function);
+}
+
+void DebugInfo::setLocation(llvm::IRBuilder<>& builder, SourceLocation loc)
+{
+    builder.SetCurrentDebugLocation(llvm::DILocation::get(builder.getContext(), loc.line, loc.column, m_function));
+}
+
+void DebugInfo::declareVariable(llvm::IRBuilder<>& builder, llvm::StringRef name, llvm::AllocaInst* store,
+                                SourceLocation loc, bool constant, int64_t lowerBound)
+{
+    llvm::DIType* type = getType(store->getAllocatedType(), lowerBound);
+    if (constant)
+        type = m_builder.createQualifiedType(llvm::dwarf::DW_TAG_const_type, type);
+
+    llvm::DILocalVariable* variable = m_builder.createAutoVariable(m_function, name, m_file, loc.line, type, true);
+    m_builder.insertDeclare(store, variable, m_builder.createExpression(),
+                            llvm::DILocation::get(builder.getContext(), loc.line, loc.column, m_function),
+                            builder.GetInsertBlock());
+}
+
+void DebugInfo::finish()
+{
+    m_builder.finalize();
+}
+
+llvm::DIType* DebugInfo::getType(llvm::Type* type, int64_t lowerBound)
+{
+    if (type->isDoubleTy())
+        return m_builder.createBasicType("real", 64, llvm::dwarf::DW_ATE_float);
+
+    if (auto* array = llvm::dyn_cast<llvm::ArrayType>(type)) {
+        llvm::DIType* element = getType(array->getElementType(), 0);
+        uint64_t count = array->getNumElements();
+        return m_builder.createArrayType(count * element->getSizeInBits(), 0, element,
+                                         m_builder.getOrCreateArray({m_builder.getOrCreateSubrange(lowerBound, count)}));
+    }
+
+    assert(type->isIntegerTy(32) && "Mila only has integers, reals and arrays of them");
+    return m_builder.createBasicType("integer", 32, llvm::dwarf::DW_ATE_signed);
+}
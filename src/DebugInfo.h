@@ -0,0 +1,41 @@
+#ifndef PJPPROJECT_DEBUGINFO_HPP
+#define PJPPROJECT_DEBUGINFO_HPP
+
+#include <llvm/IR/DIBuilder.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+
+#include "Lexer.h"
+
+/*
+ * DWARF description of a Mila program, emitted with -g.
+ *
+ * The program body becomes the subprogram of main, every instruction is attributed to the line of the
+ * statement it was generated from and every variable, constant and array is described, so perf, gdb and
+ * addr2line map the compiled binary back to the Mila source.
+ */
+class DebugInfo {
+public:
+    DebugInfo(llvm::Module& module, llvm::StringRef sourceName, bool optimized);
+
+    // Describes `function` as the code of the program, instructions emitted into it get locations from now on
+    void enterFunction(llvm::Function& function, SourceLocation loc);
+    // Attributes the instructions emitted next to `loc`
+    void setLocation(llvm::IRBuilder<>& builder, SourceLocation loc);
+    // Describes a variable kept in `store`, arrays are indexed from `lowerBound`
+    void declareVariable(llvm::IRBuilder<>& builder, llvm::StringRef name, llvm::AllocaInst* store, SourceLocation loc,
+                         bool constant = false, int64_t lowerBound = 0);
+
+    // Resolves the descriptions, has to be called before the module is verified or emitted
+    void finish();
+
+private:
+    llvm::DIType* getType(llvm::Type* type, int64_t lowerBound);
+
+    llvm::DIBuilder m_builder;
+    bool m_optimized;
+    llvm::DIFile* m_file;
+    llvm::DISubprogram* m_function = nullptr;
+};
+
+#endif //PJPPROJECT_DEBUGINFO_HPP
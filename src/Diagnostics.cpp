@@ -0,0 +1,35 @@
+#include "Diagnostics.h"
+
+void Diagnostics::error(SourceLocation loc, const llvm::Twine& message)
+{
+    m_errors.push_back({loc, message.str()});
+}
+
+// Returns the text of a 1-based line, without its line break
+static llvm::StringRef getLine(llvm::StringRef source, unsigned line)
+{
+    for (unsigned i = 1; i < line && !source.empty(); i++)
+        source = source.split('\n').second;
+    return source.split('\n').first;
+}
+
+void Diagnostics::print(llvm::raw_ostream& os, llvm::StringRef sourceName) const
+{
+    if (sourceName == "-")
+        sourceName = "<stdin>";
+
+    for (const Diagnostic& error : m_errors) {
+        os << sourceName << ":" << error.loc.line << ":" << error.loc.column << ": error: " << error.message << "\n";
+        if (error.loc.line == 0)
+            continue;
+
+        // The caret copies the tabs of the line, so it stays under the column however tabs are shown
+        llvm::StringRef text = getLine(m_source, error.loc.line);
+        os << text << "\n";
+        for (unsigned column = 1; column < error.loc.column && column <= text.size(); column++)
+            os << (text[column - 1] == '\t' ? '\t' : ' ');
+        os << "^\n";
+    }
+
+    os << m_errors.size() << (m_errors.size() == 1 ? " error" : " errors") << " generated.\n";
+}
@@ -0,0 +1,43 @@
+#ifndef PJPPROJECT_DIAGNOSTICS_HPP
+#define PJPPROJECT_DIAGNOSTICS_HPP
+
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/Twine.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "Lexer.h"
+
+/*
+ * Errors found while compiling one source. The parser and codegen report into it and carry on,
+ * the driver prints everything once the phase is over:
+ *
+ *   program.mila:7:12: error: expected ';', found 'end'
+ *       X := X + 1
+ *                 ^
+ */
+class Diagnostics {
+public:
+    explicit Diagnostics(llvm::StringRef source)
+            : m_source(source) {}
+
+    void error(SourceLocation loc, const llvm::Twine& message);
+
+    bool hasErrors() const { return !m_errors.empty(); }
+    size_t getErrorCount() const { return m_errors.size(); }
+
+    void print(llvm::raw_ostream& os, llvm::StringRef sourceName) const;
+
+private:
+    struct Diagnostic {
+        SourceLocation loc;
+        std::string message;
+    };
+
+    llvm::StringRef m_source;           // to quote the offending line
+    std::vector<Diagnostic> m_errors;
+};
+
+#endif //PJPPROJECT_DIAGNOSTICS_HPP
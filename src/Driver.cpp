@@ -0,0 +1,541 @@
+#include "Driver.h"
+
+#include <memory>
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/xxhash.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "ASTFile.h"
+#include "Parser.h"
+#include "Profile.h"
+#include "Stats.h"
+#include "TokenCache.h"
+
+// With a target machine the optimizer also knows the costs of the target's instructions
+static void Optimize(llvm::Module& module, unsigned optLevel, llvm::TargetMachine* targetMachine)
+{
+    llvm::LoopAnalysisManager LAM;
+    llvm::FunctionAnalysisManager FAM;
+    llvm::CGSCCAnalysisManager CGAM;
+    llvm::ModuleAnalysisManager MAM;
+
+    llvm::PassBuilder PB(targetMachine);
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    llvm::OptimizationLevel level = optLevel == 1 ? llvm::OptimizationLevel::O1
+                                  : optLevel == 2 ? llvm::OptimizationLevel::O2
+                                                  : llvm::OptimizationLevel::O3;
+    llvm::ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(level);
+    MPM.run(module, MAM);
+}
+
+/*
+ * Object files and assembly are generated for the host. The code is position independent, the way the
+ * host's cc links executables by default, and the CPU is the generic one of the architecture, like llc's.
+ * The targets are registered once per process, a compile server does it for all of its compilations.
+ */
+static std::unique_ptr<llvm::TargetMachine> CreateTargetMachine(unsigned optLevel, llvm::raw_ostream& err)
+{
+    static const bool initialized = [] {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        return true;
+    }();
+    (void)initialized;
+
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    std::string error;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (target == nullptr) {
+        err << "Error: no target for " << triple << ": " << error << "\n";
+        return nullptr;
+    }
+
+    llvm::CodeGenOpt::Level level = optLevel == 0 ? llvm::CodeGenOpt::None
+                                  : optLevel == 1 ? llvm::CodeGenOpt::Less
+                                  : optLevel == 2 ? llvm::CodeGenOpt::Default
+                                                  : llvm::CodeGenOpt::Aggressive;
+    return std::unique_ptr<llvm::TargetMachine>(
+            target->createTargetMachine(triple, "", "", llvm::TargetOptions(), llvm::Reloc::PIC_, llvm::None, level));
+}
+
+// Writes the module in the --emit format. IR and bitcode are streamed into `os` as they are produced
+static bool EmitModule(llvm::Module& module, EmitKind emit, llvm::TargetMachine* targetMachine, llvm::raw_ostream& os,
+                       llvm::raw_ostream& err)
+{
+    switch (emit) {
+        case EmitKind::LLVMIR:
+            module.print(os, nullptr);
+            return true;
+        case EmitKind::Bitcode:
+            llvm::WriteBitcodeToFile(module, os);
+            return true;
+        case EmitKind::Object:
+        case EmitKind::Assembly:
+            break;
+        case EmitKind::AST:
+            llvm_unreachable("the AST is written before codegen");
+    }
+
+    // The object writer seeks back to patch what it wrote, a pipe or a string gets the file through a buffer
+    auto* file = os.get_kind() == llvm::raw_ostream::OStreamKind::OK_FDStream ? static_cast<llvm::raw_fd_ostream*>(&os) : nullptr;
+    std::unique_ptr<llvm::buffer_ostream> buffer;
+    llvm::raw_pwrite_stream* stream = file;
+    if (file == nullptr || !file->supportsSeeking()) {
+        buffer = std::make_unique<llvm::buffer_ostream>(os);
+        stream = buffer.get();
+    }
+
+    llvm::legacy::PassManager PM;
+    if (targetMachine->addPassesToEmitFile(PM, *stream, nullptr,
+                                           emit == EmitKind::Object ? llvm::CGFT_ObjectFile : llvm::CGFT_AssemblyFile)) {
+        err << "Error: the target cannot emit this kind of file\n";
+        return false;
+    }
+    PM.run(module);
+    return true;
+}
+
+static const char* EmitExtension(EmitKind emit)
+{
+    switch (emit) {
+        case EmitKind::LLVMIR: return ".ll";
+        case EmitKind::Bitcode: return ".bc";
+        case EmitKind::Object: return ".o";
+        case EmitKind::Assembly: return ".s";
+        case EmitKind::AST: return ".ast";
+    }
+    llvm_unreachable("unknown output format");
+}
+
+// The compiler binary in a cache key, rebuilding mila invalidates the whole cache
+static bool WriteCompilerKey(llvm::raw_ostream& os)
+{
+    std::string compiler = llvm::sys::fs::getMainExecutable(nullptr, reinterpret_cast<void*>(static_cast<int (*)(const CompileOptions&)>(&Compile)));
+    llvm::sys::fs::file_status compilerStatus;
+    if (compiler.empty() || llvm::sys::fs::status(compiler, compilerStatus))
+        return false;
+    os << compiler << "\n" << compilerStatus.getSize() << " "
+       << compilerStatus.getLastModificationTime().time_since_epoch().count() << "\n";
+    return true;
+}
+
+/*
+ * The cache keeps the output of earlier compilations in --cache-dir, one file per distinct input.
+ * An entry is named by a hash of everything the output depends on: the source and its name, the options
+ * that change the generated IR, the contents of a used profile and the compiler binary itself, so
+ * rebuilding mila invalidates the whole cache. Returns "" when the key cannot be computed.
+ */
+static std::string CachePath(const CompileOptions& options, llvm::StringRef source)
+{
+    std::string key;
+    llvm::raw_string_ostream os(key);
+    os << "mila-cache 1\n";
+    if (!WriteCompilerKey(os))
+        return "";
+
+    os << options.inputFile << "\n" << llvm::format_hex_no_prefix(llvm::xxHash64(source), 16) << "\n";
+    os << "O" << options.optLevel << " g" << options.debugInfo << " emit" << static_cast<int>(options.emit) << "\n";
+    os << "profile-generate " << options.profileGenerate << "\n";
+    os << "line-profile " << options.lineProfile << "\n";
+    if (!options.profileUse.empty()) {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> profile = llvm::MemoryBuffer::getFile(options.profileUse);
+        if (!profile)
+            return "";
+        os << "profile-use " << llvm::format_hex_no_prefix(llvm::xxHash64((*profile)->getBuffer()), 16) << "\n";
+    }
+    os.flush();
+
+    llvm::SmallString<128> path(options.cacheDir);
+    llvm::sys::path::append(path, llvm::utohexstr(llvm::xxHash64(key), true, 16) + EmitExtension(options.emit));
+    return std::string(path);
+}
+
+// The tokens of a source only depend on the source and the lexer, every compilation of it shares them
+static std::string TokenCachePath(const CompileOptions& options, uint64_t sourceHash)
+{
+    std::string key;
+    llvm::raw_string_ostream os(key);
+    os << "mila-tokens 1\n";
+    if (!WriteCompilerKey(os))
+        return "";
+    os << llvm::format_hex_no_prefix(sourceHash, 16) << "\n";
+    os.flush();
+
+    llvm::SmallString<128> path(options.cacheDir);
+    llvm::sys::path::append(path, llvm::utohexstr(llvm::xxHash64(key), true, 16) + ".tok");
+    return std::string(path);
+}
+
+// Entries are written to a temporary file and renamed, a concurrent compilation never reads half of one
+static void StoreInCache(llvm::StringRef path, llvm::StringRef contents, llvm::raw_ostream& err)
+{
+    int fd;
+    llvm::SmallString<128> temporary;
+    if (llvm::sys::fs::create_directories(llvm::sys::path::parent_path(path))
+        || llvm::sys::fs::createUniqueFile(path + ".tmp%%%%%%", fd, temporary)) {
+        err << "Warning: cannot write to the cache " << llvm::sys::path::parent_path(path) << "\n";
+        return;
+    }
+
+    llvm::raw_fd_ostream file(fd, true);
+    file << contents;
+    file.close();
+    if (file.has_error() || llvm::sys::fs::rename(temporary, path)) {
+        file.clear_error();
+        llvm::sys::fs::remove(temporary);
+        err << "Warning: cannot write to the cache " << llvm::sys::path::parent_path(path) << "\n";
+    }
+}
+
+// A recording ends with tok_eof once the source is parsed, whether or not it has errors
+static void StoreTokens(llvm::StringRef path, const TokenWriter& recorder, llvm::StringRef source, uint64_t sourceHash,
+                        llvm::raw_ostream& err)
+{
+    if (!path.empty() && recorder.complete())
+        StoreInCache(path, recorder.finish(sourceHash, source.size()), err);
+}
+
+// Semantic analysis of a parsed program, false when it has errors
+static bool Analyze(Parser& parser, CompileStats* stats)
+{
+    CompileStats::Timer timer(stats, CompileStats::Sema);
+    llvm::TimeTraceScope traceScope("Sema");
+    return parser.Analyze();
+}
+
+static int CompileModule(const CompileOptions& options, const CompileIO& io);
+
+int Compile(const CompileOptions& options)
+{
+    return Compile(options, {llvm::outs(), llvm::errs()});
+}
+
+int Compile(const CompileOptions& options, const CompileIO& io)
+{
+    if (!options.timeTrace)
+        return CompileModule(options, io);
+
+    llvm::timeTraceProfilerInitialize(options.timeTraceGranularity, "mila");
+    int result;
+    {
+        llvm::TimeTraceScope traceScope("Compile", options.inputFile);
+        result = CompileModule(options, io);
+    }
+
+    // Named after the output, or after the input when the output is standard output
+    std::string traceName = options.outputFile != "-" ? options.outputFile
+                          : options.inputFile != "-" ? options.inputFile : "mila";
+    if (llvm::Error error = llvm::timeTraceProfilerWrite(options.timeTraceFile, traceName)) {
+        io.err << "Error writing time trace: " << llvm::toString(std::move(error)) << "\n";
+        result = 1;
+    }
+    llvm::timeTraceProfilerCleanup();
+    return result;
+}
+
+// Opens a file named on the command line, "-" is the standard output of the compilation
+static llvm::raw_ostream* OpenOutput(const std::string& path, const CompileIO& io, std::unique_ptr<llvm::raw_fd_ostream>& file)
+{
+    if (path == "-")
+        return &io.out;
+
+    std::error_code error;
+    file = std::make_unique<llvm::raw_fd_ostream>(path, error);
+    if (error) {
+        io.err << "Error opening file " << path << ": " << error.message() << "\n";
+        return nullptr;
+    }
+    return file.get();
+}
+
+// The time report and counters a compilation was asked for
+static bool WriteStats(const CompileStats& stats, const CompileOptions& options, const CompileIO& io)
+{
+    if (options.timeReport)
+        stats.printTimeReport(io.err);
+    if (options.stats)
+        stats.printStats(io.err);
+    if (!options.statsFile.empty()) {
+        std::unique_ptr<llvm::raw_fd_ostream> file;
+        llvm::raw_ostream* statsFile = OpenOutput(options.statsFile, io, file);
+        if (statsFile == nullptr)
+            return false;
+        stats.printJSON(*statsFile);
+    }
+    return true;
+}
+
+static int CompileModule(const CompileOptions& options, const CompileIO& io)
+{
+    std::unique_ptr<CompileStats> stats;
+    if (options.timeReport || options.stats || !options.statsFile.empty())
+        stats = std::make_unique<CompileStats>();
+
+    // Nothing reads past the end of the input, so a large file is memory-mapped as it is
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> source =
+            options.inputFile == "-" && io.input != nullptr
+                    ? llvm::MemoryBuffer::getMemBuffer(*io.input, "<stdin>")
+                    : llvm::MemoryBuffer::getFileOrSTDIN(options.inputFile, false, false);
+    if (std::error_code error = source.getError()) {
+        io.err << "Error opening file " << options.inputFile << ": " << error.message() << "\n";
+        return 1;
+    }
+
+    // A program written with --emit=ast is compiled from its tree, in place of lexing and parsing the source
+    llvm::Optional<ASTFile> astFile;
+    if (ASTFile::isASTFile((*source)->getBuffer())) {
+        astFile.emplace();
+        if (!astFile->open((*source)->getBuffer())) {
+            io.err << "Error reading AST file " << options.inputFile << ": damaged or written by another version\n";
+            return 1;
+        }
+        if (!options.lineReport.empty()) {
+            io.err << "Error: a line report needs the source of the program, not an AST file\n";
+            return 1;
+        }
+    }
+
+    if (!options.lineReport.empty()) {
+        if (llvm::Error error = LineProfile::printReport((*source)->getBuffer(), options.lineReport, io.out)) {
+            io.err << "Error reading line profile " << llvm::toString(std::move(error)) << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    // A time report or counters describe an actual compilation, with them the cache is not consulted
+    std::string cachePath;
+    if (!options.cacheDir.empty() && !stats)
+        cachePath = CachePath(options, (*source)->getBuffer());
+    if (!cachePath.empty()) {
+        if (llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> cached = llvm::MemoryBuffer::getFile(cachePath)) {
+            std::unique_ptr<llvm::raw_fd_ostream> file;
+            llvm::raw_ostream* outputFile = OpenOutput(options.outputFile, io, file);
+            if (outputFile == nullptr)
+                return 1;
+            *outputFile << (*cached)->getBuffer();
+            return 0;
+        }
+    }
+
+    Parser parser(astFile ? llvm::StringRef() : (*source)->getBuffer());
+    parser.setStats(stats.get());
+    uint64_t sourceHash = llvm::xxHash64((*source)->getBuffer());
+
+    // The tree of an AST file is materialized where the source would be parsed
+    auto parse = [&]() {
+        CompileStats::Timer timer(stats.get(), CompileStats::Parse);
+        if (astFile) {
+            llvm::TimeTraceScope traceScope("LoadAST");
+            parser.setProgram(astFile->materialize());
+            return true;
+        }
+        llvm::TimeTraceScope traceScope("Parse");
+        return parser.Parse();
+    };
+
+    // Unlike the output, cached tokens are also used for a time report: parsing and codegen still run.
+    // A large recording is memory-mapped, the replayed tokens point into it until parsing is done.
+    std::string tokenPath;
+    std::unique_ptr<llvm::MemoryBuffer> tokenFile;
+    TokenReader tokenReplay;
+    TokenWriter tokenRecorder;
+    if (!options.cacheDir.empty() && !astFile)
+        tokenPath = TokenCachePath(options, sourceHash);
+    if (!tokenPath.empty()) {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> cached = llvm::MemoryBuffer::getFile(tokenPath, false, false);
+        if (cached && tokenReplay.open((*cached)->getBuffer(), sourceHash, (*source)->getBufferSize())) {
+            tokenFile = std::move(*cached);
+            parser.setTokenReplay(&tokenReplay);
+        } else {
+            parser.setTokenRecorder(&tokenRecorder);
+        }
+    }
+
+    // Counters are numbered in codegen order, the hash ties a profile to the exact source it came from
+    llvm::Optional<BranchProfile> profile;
+    if (!options.profileGenerate.empty()) {
+        profile = BranchProfile::instrument(sourceHash, options.profileGenerate);
+    } else if (!options.profileUse.empty()) {
+        llvm::Expected<BranchProfile> used = BranchProfile::read(options.profileUse, sourceHash);
+        if (!used) {
+            io.err << "Error reading profile " << llvm::toString(used.takeError()) << "\n";
+            return 1;
+        }
+        profile = std::move(*used);
+    }
+    parser.setProfile(profile ? &*profile : nullptr);
+
+    llvm::Optional<LineProfile> lineProfile;
+    if (!options.lineProfile.empty())
+        lineProfile.emplace(options.lineProfile);
+    parser.setLineProfile(lineProfile ? &*lineProfile : nullptr);
+
+    if (options.debugInfo)
+        parser.enableDebugInfo(options.inputFile, options.optLevel > 0);
+
+    // The program is written as parsed, the whole AST is kept for it and nothing is generated
+    if (options.emit == EmitKind::AST) {
+        bool parsed = parse();
+        StoreTokens(tokenPath, tokenRecorder, (*source)->getBuffer(), sourceHash, io.err);
+        if (!parsed) {
+            parser.getDiagnostics().print(io.err, options.inputFile);
+            return 1;
+        }
+        if (stats) {
+            stats->finishLexing();
+            stats->countAST(parser.getProgram());
+        }
+        // A file is only written for a valid program, though it holds none of the analysis
+        if (!Analyze(parser, stats.get())) {
+            parser.getDiagnostics().print(io.err, options.inputFile);
+            return 1;
+        }
+
+        std::string contents;
+        {
+            CompileStats::Timer timer(stats.get(), CompileStats::Emit);
+            llvm::TimeTraceScope traceScope("Emit");
+            contents = writeASTFile(parser.getProgram());
+        }
+        std::unique_ptr<llvm::raw_fd_ostream> file;
+        llvm::raw_ostream* outputFile = OpenOutput(options.outputFile, io, file);
+        if (outputFile == nullptr)
+            return 1;
+        *outputFile << contents;
+        outputFile->flush();
+        if (!cachePath.empty())
+            StoreInCache(cachePath, contents, io.err);
+        if (stats && !WriteStats(*stats, options, io))
+            return 1;
+        return 0;
+    }
+
+    llvm::Module* module;
+    // An AST file has nothing to lex, it is never pipelined
+    if (options.pipeline && !astFile) {
+        bool parsed;
+        {
+            CompileStats::Timer timer(stats.get(), CompileStats::Parse);
+            llvm::TimeTraceScope traceScope("ParseAndGenerate");
+            parsed = parser.ParseAndGenerate();
+        }
+        StoreTokens(tokenPath, tokenRecorder, (*source)->getBuffer(), sourceHash, io.err);
+        if (!parsed) {
+            parser.getDiagnostics().print(io.err, options.inputFile);
+            return 1;
+        }
+        module = &parser.getModule();
+        if (stats) {
+            stats->finishPipeline();
+            stats->countAST(parser.getProgram());
+        }
+    } else {
+        bool parsed = parse();
+        StoreTokens(tokenPath, tokenRecorder, (*source)->getBuffer(), sourceHash, io.err);
+        if (!parsed) {
+            parser.getDiagnostics().print(io.err, options.inputFile);
+            return 1;
+        }
+        if (stats) {
+            stats->finishLexing();
+            stats->countAST(parser.getProgram());
+        }
+        if (!Analyze(parser, stats.get())) {
+            parser.getDiagnostics().print(io.err, options.inputFile);
+            return 1;
+        }
+
+        // The AST is counted, nothing needs it once it is lowered
+        CompileStats::Timer timer(stats.get(), CompileStats::Codegen);
+        llvm::TimeTraceScope traceScope("Codegen");
+        parser.setReleaseAST(true);
+        module = &parser.Generate();
+    }
+
+    std::unique_ptr<llvm::raw_fd_ostream> file;
+    llvm::raw_ostream* outputFile = OpenOutput(options.outputFile, io, file);
+    if (outputFile == nullptr)
+        return 1;
+
+    {
+        CompileStats::Timer timer(stats.get(), CompileStats::Codegen);
+        if (profile) {
+            if (llvm::Error error = profile->finish(*module)) {
+                io.err << "Error applying profile " << options.profileUse << ": " << llvm::toString(std::move(error)) << "\n";
+                return 1;
+            }
+        }
+        if (lineProfile)
+            lineProfile->finish(*module, options.inputFile);
+    }
+    if (stats)
+        stats->countIR(*module, false);
+
+    {
+        CompileStats::Timer timer(stats.get(), CompileStats::Verify);
+        llvm::TimeTraceScope traceScope("Verify");
+        if (llvm::verifyModule(*module, &io.err))
+            return 1;
+    }
+
+    // Machine code is optimized for the target it is generated for, IR and bitcode stay target independent
+    std::unique_ptr<llvm::TargetMachine> targetMachine;
+    if (options.emit == EmitKind::Object || options.emit == EmitKind::Assembly) {
+        targetMachine = CreateTargetMachine(options.optLevel, io.err);
+        if (!targetMachine)
+            return 1;
+        module->setTargetTriple(targetMachine->getTargetTriple().str());
+        module->setDataLayout(targetMachine->createDataLayout());
+    }
+
+    if (options.optLevel > 0) {
+        {
+            CompileStats::Timer timer(stats.get(), CompileStats::Optimize);
+            llvm::TimeTraceScope traceScope("Optimize");
+            Optimize(*module, options.optLevel, targetMachine.get());
+        }
+        if (stats)
+            stats->countIR(*module, true);
+    }
+
+    {
+        CompileStats::Timer timer(stats.get(), CompileStats::Emit);
+        llvm::TimeTraceScope traceScope("Emit");
+        if (cachePath.empty()) {
+            if (!EmitModule(*module, options.emit, targetMachine.get(), *outputFile, io.err))
+                return 1;
+        } else {
+            llvm::SmallString<0> contents;
+            llvm::raw_svector_ostream os(contents);
+            if (!EmitModule(*module, options.emit, targetMachine.get(), os, io.err))
+                return 1;
+            *outputFile << contents;
+            StoreInCache(cachePath, contents, io.err);
+        }
+        outputFile->flush();
+    }
+
+    if (stats && !WriteStats(*stats, options, io))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef PJPPROJECT_DRIVER_HPP
+#define PJPPROJECT_DRIVER_HPP
+
+#include <string>
+
+namespace llvm {
+class raw_ostream;
+}
+
+// Format of the output file (--emit)
+enum class EmitKind {
+    LLVMIR,                         // textual IR, .ll
+    Bitcode,                        // .bc
+    Object,                         // object file of the host, .o
+    Assembly,                       // assembly of the host, .s
+    AST                             // the parsed program, nothing is generated, .ast (see ASTFile.h)
+};
+
+// Everything one compilation depends on, filled in from the command line by main
+struct CompileOptions {
+    std::string inputFile = "-";    // "-" reads standard input
+    std::string outputFile;
+    EmitKind emit = EmitKind::LLVMIR;
+    unsigned optLevel = 0;          // 0 leaves the IR as generated, 1-3 run the LLVM default pipelines
+    bool debugInfo = false;         // DWARF line tables and variables (-g)
+    bool pipeline = false;          // lex on a thread of its own, generate every top-level statement once it is parsed
+
+    bool timeReport = false;        // per-phase time and memory on stderr
+    bool stats = false;             // counters on stderr
+    std::string statsFile;          // time report and counters as JSON, "-" for stdout (--stats-file)
+
+    std::string profileGenerate;    // instrument branches, the program adds its counts to this file at exit
+    std::string profileUse;         // profile of the same source written by a --profile-generate build
+    std::string lineProfile;        // count statements and loop iterations, the program writes them to this file
+    std::string lineReport;         // print the input annotated with the counts of this --line-profile file
+
+    std::string cacheDir;           // reuse the output of an earlier compilation of the same input, options and compiler
+
+    bool timeTrace = false;         // chrome://tracing / Perfetto JSON of the compilation
+    std::string timeTraceFile;      // defaults to <output>.time-trace
+    unsigned timeTraceGranularity = 500;    // microseconds, shorter spans are only summed up
+};
+
+// Standard streams of one compilation, the compile server substitutes those of its client
+struct CompileIO {
+    llvm::raw_ostream& out;             // output, statistics or report named "-"
+    llvm::raw_ostream& err;             // diagnostics, time report and counters
+    const std::string* input = nullptr; // standard input, read from the process when null
+};
+
+// Compiles the input file into the output file; returns the process exit code
+int Compile(const CompileOptions& options);
+int Compile(const CompileOptions& options, const CompileIO& io);
+
+#endif //PJPPROJECT_DRIVER_HPP
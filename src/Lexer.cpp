@@ -1,133 +1,108 @@
 #include "Lexer.h"
+
+#include <llvm/ADT/APFloat.h>
+#include <llvm/ADT/StringSwitch.h>
+#include <llvm/Support/Error.h>
+
+#include "CharScan.h"
 using namespace std;
 
 
 Token Lexer::gettok()
 {
-
-    static int lastChar = ' ';
-    if ( lastChar == '=' || lastChar == '>')
-        lastChar = ' ';
+    m_LiteralError = nullptr;
 
     // Skipping whitespace characters
-    while (isspace(lastChar))
-        lastChar = cin.get();
+    Newlines newlines;
+    m_Cur = scanSpace(m_Cur, m_End, newlines);
+    if (newlines.count != 0) {
+        m_Line += newlines.count;
+        m_LineStart = newlines.last + 1;
+    }
+
+    if (m_Cur == m_End) {
+        m_TokenLoc = m_TokenEnd = endLocation();
+        return tok_eof;
+    }
+
+    m_TokenLoc = locationOf(m_Cur);
+    Token tok = lexToken();
+    m_TokenEnd = m_Cur == m_End ? endLocation() : locationOf(m_Cur);
+    return tok;
+}
+
+Token Lexer::lexToken()
+{
+    const char* start = m_Cur;
 
     // Identifier or keyword
-    if (isalpha(lastChar)) {
-        m_IdentifierStr = lastChar;
-        while (isalnum((lastChar = getchar())))
-            m_IdentifierStr += lastChar;
-
-        if (m_IdentifierStr == "begin")
-            return tok_begin;
-        if (m_IdentifierStr == "end")
-            return tok_end;
-        if (m_IdentifierStr == "const")
-            return tok_const;
-        if (m_IdentifierStr == "procedure")
-            return tok_procedure;
-        if (m_IdentifierStr == "forward")
-            return tok_forward;
-        if (m_IdentifierStr == "function")
-            return tok_function;
-        if (m_IdentifierStr == "if")
-            return tok_if;
-        if (m_IdentifierStr == "then")
-            return tok_then;
-        if (m_IdentifierStr == "else")
-            return tok_else;
-        if (m_IdentifierStr == "program")
-            return tok_program;
-        if (m_IdentifierStr == "while")
-            return tok_while;
-        if (m_IdentifierStr == "exit")
-            return tok_exit;
-        if (m_IdentifierStr == "var")
-            return tok_var;
-        if (m_IdentifierStr == "integer")
-            return tok_integer;
-        if (m_IdentifierStr == "for")
-            return tok_for;
-        if (m_IdentifierStr == "do")
-            return tok_do;
-        if (m_IdentifierStr == "to")
-            return tok_to;
-        if (m_IdentifierStr == "downto")
-            return tok_downto;
-        if (m_IdentifierStr == "array")
-            return tok_array;
-        if (m_IdentifierStr == "writeln")
-            return tok_writeln;
-        if (m_IdentifierStr == "readln")
-            return tok_readln;
-        if (m_IdentifierStr == "break")
-            return tok_break;
-        if (m_IdentifierStr == "write")
-            return tok_write;
-        if (m_IdentifierStr == "of")
-            return tok_of;
-
-        // Some operators
-        if (m_IdentifierStr == "or")
-            return tok_or;
-        if (m_IdentifierStr == "mod")
-            return tok_mod;
-        if (m_IdentifierStr == "div")
-            return tok_div;
-        if (m_IdentifierStr == "not")
-            return tok_not;
-        if (m_IdentifierStr == "and")
-            return tok_and;
-        if (m_IdentifierStr == "xor")
-            return tok_xor;
-
-        return tok_identifier;
+    if (isAlphaChar(*m_Cur)) {
+        m_Cur = scanAlnum(m_Cur + 1, m_End);
+        llvm::StringRef word(start, m_Cur - start);
+
+        Token keyword = llvm::StringSwitch<Token>(word)
+                .Case("begin", tok_begin)
+                .Case("end", tok_end)
+                .Case("const", tok_const)
+                .Case("procedure", tok_procedure)
+                .Case("forward", tok_forward)
+                .Case("function", tok_function)
+                .Case("if", tok_if)
+                .Case("then", tok_then)
+                .Case("else", tok_else)
+                .Case("program", tok_program)
+                .Case("while", tok_while)
+                .Case("exit", tok_exit)
+                .Case("var", tok_var)
+                .Case("integer", tok_integer)
+                .Case("for", tok_for)
+                .Case("do", tok_do)
+                .Case("to", tok_to)
+                .Case("downto", tok_downto)
+                .Case("array", tok_array)
+                .Case("writeln", tok_writeln)
+                .Case("readln", tok_readln)
+                .Case("break", tok_break)
+                .Case("continue", tok_continue)
+                .Case("write", tok_write)
+                .Case("of", tok_of)
+
+                // Some operators
+                .Case("or", tok_or)
+                .Case("mod", tok_mod)
+                .Case("div", tok_div)
+                .Case("not", tok_not)
+                .Case("and", tok_and)
+                .Case("xor", tok_xor)
+                .Default(tok_identifier);
+
+        if (keyword == tok_identifier)
+            m_IdentifierStr.assign(start, m_Cur);
+        return keyword;
     }
 
 
     // Number
-    if (isdigit(lastChar) )
-    {
-        string numStr;
-        do {
-            numStr += lastChar;
-            lastChar = cin.get();
-        } while (isdigit(lastChar));
-
-        m_NumVal = stoi(numStr);
-        return tok_number;
-    }
+    if (isDigitChar(*m_Cur))
+        return lexDecimal();
 
     // Octal
-    if ( lastChar == '&')
+    if (*m_Cur == '&')
     {
-        string numStr;
-        lastChar = cin.get();
-        do {
-            numStr += lastChar;
-            lastChar = cin.get();
-        } while (isdigit(lastChar));
-        m_NumVal = stoi(numStr, 0, 8);
-        return tok_number;
+        m_Cur++;
+        return lexBased(8);
     }
 
     // Hex
-    if (lastChar == '$')
+    if (*m_Cur == '$')
     {
-        string numStr;
-        lastChar = cin.get();
-        do {
-            numStr += lastChar;
-            lastChar = cin.get();
-        } while (isdigit(lastChar));
-        m_NumVal = stoi(numStr, 0, 16);
-        return tok_number;
+        m_Cur++;
+        return lexBased(16);
     }
 
 
-    int thisChar = lastChar;
-    lastChar = cin.get();
+    char thisChar = *m_Cur++;
+    char nextChar = m_Cur != m_End ? *m_Cur : '\0';
 
     // Punctuation signs and operators
     switch ( thisChar )
@@ -158,24 +133,26 @@ Token Lexer::gettok()
 
     switch ( thisChar )
     {
-        case EOF:
-            return tok_eof;
         case '<':
-            if (lastChar == '=')
+            if (nextChar == '=') {
+                m_Cur++;
                 return tok_lessequal;
-            else if (lastChar == '>')
+            } else if (nextChar == '>') {
+                m_Cur++;
                 return tok_notequal;
-            else
+            } else
                 return tok_less;
         case '>':
-            if (lastChar == '=')
+            if (nextChar == '=') {
+                m_Cur++;
                 return tok_greaterequal;
-            else
+            } else
                 return tok_greater;
         case ':':
-            if (lastChar == '=')
+            if (nextChar == '=') {
+                m_Cur++;
                 return tok_assign;
-            else
+            } else
                 return tok_colon;
     }
 
@@ -183,3 +160,169 @@ Token Lexer::gettok()
     return tok_undefined;
 }
 
+// Value of a digit in any base up to 16, 16 or more for anything else
+static inline unsigned DigitValue(char c)
+{
+    if (isDigitChar(c))
+        return c - '0';
+    unsigned lower = static_cast<unsigned char>(c) | 0x20;
+    return lower >= 'a' && lower <= 'f' ? lower - 'a' + 10 : 16;
+}
+
+// Adds a digit to a number, returns false once it no longer fits in 64 bits
+static inline bool AccumulateDigit(uint64_t& value, unsigned base, unsigned digit)
+{
+    return !__builtin_mul_overflow(value, base, &value) && !__builtin_add_overflow(value, digit, &value)
+           && value <= static_cast<uint64_t>(INT64_MAX);
+}
+
+Token Lexer::lexDecimal()
+{
+    const char* start = m_Cur;
+    uint64_t value = 0;
+    // 18 digits always fit, only longer numbers are checked for overflow
+    for (const char* safe = m_Cur + std::min<ptrdiff_t>(m_End - m_Cur, 18); m_Cur != safe && isDigitChar(*m_Cur); m_Cur++)
+        value = value * 10 + (*m_Cur - '0');
+    bool fits = true;
+    for (; m_Cur != m_End && isDigitChar(*m_Cur); m_Cur++)
+        fits = fits && AccumulateDigit(value, 10, *m_Cur - '0');
+
+    // A fraction needs a digit after the '.', "1..5" is a range
+    bool fraction = m_End - m_Cur >= 2 && m_Cur[0] == '.' && isDigitChar(m_Cur[1]);
+    if (fraction)
+        m_Cur = scanDigits(m_Cur + 2, m_End);
+
+    // So does an exponent, "1else" is a number and a keyword
+    bool exponent = false;
+    if (m_Cur != m_End && (*m_Cur | 0x20) == 'e') {
+        const char* digits = m_Cur + 1;
+        if (digits != m_End && (*digits == '+' || *digits == '-'))
+            digits++;
+        exponent = digits != m_End && isDigitChar(*digits);
+        if (exponent)
+            m_Cur = scanDigits(digits, m_End);
+    }
+
+    if (fraction || exponent) {
+        llvm::APFloat real(llvm::APFloat::IEEEdouble());
+        auto status = real.convertFromString(llvm::StringRef(start, m_Cur - start), llvm::APFloat::rmNearestTiesToEven);
+        if (!status || (*status & llvm::APFloat::opOverflow)) {
+            llvm::consumeError(status.takeError());
+            m_LiteralError = "real number is out of range";
+            m_RealVal = 0;
+        } else {
+            m_RealVal = real.convertToDouble();
+        }
+        return tok_real;
+    }
+
+    if (!fits)
+        m_LiteralError = "number does not fit in 64 bits";
+    m_NumVal = fits ? value : 0;
+    return tok_number;
+}
+
+Token Lexer::lexBased(unsigned base)
+{
+    const char* digits = m_Cur;
+    uint64_t value = 0;
+    unsigned digit;
+    // As many digits as fit in 63 bits are not checked
+    ptrdiff_t safeDigits = base == 8 ? 21 : 15;
+    for (const char* safe = m_Cur + std::min(m_End - m_Cur, safeDigits); m_Cur != safe && (digit = DigitValue(*m_Cur)) < base; m_Cur++)
+        value = value * base + digit;
+    bool fits = true;
+    for (; m_Cur != m_End && (digit = DigitValue(*m_Cur)) < base; m_Cur++)
+        fits = fits && AccumulateDigit(value, base, digit);
+
+    if (m_Cur == digits)
+        m_LiteralError = base == 8 ? "expected octal digits after '&'" : "expected hexadecimal digits after '$'";
+    else if (!fits)
+        m_LiteralError = "number does not fit in 64 bits";
+
+    // '8' and '9' are digits, but not octal ones: the whole run is taken as one bad number
+    if (base == 8 && m_Cur != m_End && isDigitChar(*m_Cur)) {
+        m_Cur = scanDigits(m_Cur, m_End);
+        m_LiteralError = "invalid digit in octal number";
+    }
+
+    m_NumVal = m_LiteralError == nullptr ? value : 0;
+    return tok_number;
+}
+
+SourceLocation Lexer::endLocation() const
+{
+    if (m_Begin == m_End)
+        return {};
+    const char* last = m_End - 1;
+    if (*last != '\n')
+        return locationOf(last);
+
+    // The last line break was counted already, its column is on the line before
+    const char* lineStart = last;
+    while (lineStart != m_Begin && lineStart[-1] != '\n')
+        lineStart--;
+    return {m_Line - 1, static_cast<unsigned>(last - lineStart) + 1};
+}
+
+
+const char* getTokenSpelling(Token tok)
+{
+    switch (tok) {
+        case tok_eof: return "end of file";
+        case tok_identifier: return "identifier";
+        case tok_number: return "number";
+        case tok_real: return "real number";
+        case tok_begin: return "'begin'";
+        case tok_end: return "'end'";
+        case tok_const: return "'const'";
+        case tok_procedure: return "'procedure'";
+        case tok_forward: return "'forward'";
+        case tok_function: return "'function'";
+        case tok_if: return "'if'";
+        case tok_then: return "'then'";
+        case tok_else: return "'else'";
+        case tok_program: return "'program'";
+        case tok_while: return "'while'";
+        case tok_exit: return "'exit'";
+        case tok_var: return "'var'";
+        case tok_integer: return "'integer'";
+        case tok_for: return "'for'";
+        case tok_do: return "'do'";
+        case tok_notequal: return "'<>'";
+        case tok_lessequal: return "'<='";
+        case tok_greaterequal: return "'>='";
+        case tok_assign: return "':='";
+        case tok_or: return "'or'";
+        case tok_mod: return "'mod'";
+        case tok_div: return "'div'";
+        case tok_not: return "'not'";
+        case tok_and: return "'and'";
+        case tok_xor: return "'xor'";
+        case tok_to: return "'to'";
+        case tok_downto: return "'downto'";
+        case tok_array: return "'array'";
+        case tok_semicolon: return "';'";
+        case tok_dot: return "'.'";
+        case tok_comma: return "','";
+        case tok_equal: return "'='";
+        case tok_colon: return "':'";
+        case tok_leftparenthesis: return "'('";
+        case tok_rightparenthesis: return "')'";
+        case tok_sum: return "'+'";
+        case tok_substract: return "'-'";
+        case tok_multiply: return "'*'";
+        case tok_less: return "'<'";
+        case tok_greater: return "'>'";
+        case tok_squareleftparenthesis: return "'['";
+        case tok_squarerightparenthesis: return "']'";
+        case tok_writeln: return "'writeln'";
+        case tok_readln: return "'readln'";
+        case tok_break: return "'break'";
+        case tok_write: return "'write'";
+        case tok_of: return "'of'";
+        case tok_continue: return "'continue'";
+        case tok_undefined: return "unknown character";
+    }
+    return "unknown token";
+}
@@ -1,7 +1,11 @@
 #ifndef PJPPROJECT_LEXER_HPP
 #define PJPPROJECT_LEXER_HPP
 
+#include <cstdint>
 #include <iostream>
+#include <string>
+
+#include <llvm/ADT/StringRef.h>
 
 
 /*
@@ -75,24 +79,72 @@ enum Token {
     tok_break                    = -49,
     tok_write                    = -50,
     tok_of                       = -51,
+    tok_continue                 = -52,
+
+    // number with a fraction or an exponent
+    tok_real                     = -53,
 
 
     // undefined
     tok_undefined                = 0
 };
 
+// How a token is shown in diagnostics, e.g. "'begin'" or "identifier"
+const char* getTokenSpelling(Token tok);
+
+// Position in the source, both 1-based; line 0 is an unknown location
+struct SourceLocation {
+    unsigned line = 0;
+    unsigned column = 0;
+};
+
+/*
+ * Reads tokens from a source held in memory; the buffer must outlive the lexer.
+ */
 class Lexer {
 public:
-    Lexer() = default;
+    explicit Lexer(llvm::StringRef source)
+            : m_Begin(source.begin()), m_Cur(source.begin()), m_End(source.end()), m_LineStart(source.begin()) {}
     ~Lexer() = default;
 
     Token gettok();
-    std::string identifierStr() const { return m_IdentifierStr; }
-    int numVal() const { return this->m_NumVal; }
+    const std::string& identifierStr() const { return m_IdentifierStr; }
+    int64_t numVal() const { return this->m_NumVal; }
+    double realVal() const { return m_RealVal; }
+    // What is wrong with the number last returned, nullptr when it is well-formed
+    const char* literalError() const { return m_LiteralError; }
+    // Where the token last returned by gettok starts
+    SourceLocation tokenLoc() const { return m_TokenLoc; }
+    // Just past the end of that token
+    SourceLocation tokenEnd() const { return m_TokenEnd; }
 
 private:
+    // Lexes the token at m_Cur, which is not a space and not the end
+    Token lexToken();
+    // Lexes a decimal number or a real from its first digit at m_Cur
+    Token lexDecimal();
+    // Lexes the digits of a number in base 8 or 16, m_Cur is just past its prefix
+    Token lexBased(unsigned base);
+    // Location of the character at p, m_Cur or before it on the same line
+    SourceLocation locationOf(const char* p) const
+    {
+        return {m_Line, static_cast<unsigned>(p - m_LineStart) + 1};
+    }
+    // Where the source ends: its last character, or line 0 for an empty source
+    SourceLocation endLocation() const;
+
+    const char* m_Begin;
+    const char* m_Cur;                  // the first character not lexed yet
+    const char* m_End;
+    const char* m_LineStart;            // of m_Cur's line
+    unsigned m_Line = 1;                // of m_Cur
+    SourceLocation m_TokenLoc;
+    SourceLocation m_TokenEnd;
+
     std::string m_IdentifierStr;
-    int m_NumVal;
+    int64_t m_NumVal;
+    double m_RealVal;
+    const char* m_LiteralError = nullptr;
 
 };
 
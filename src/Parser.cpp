@@ -1,59 +1,311 @@
 #include "Parser.h"
 #include <iostream>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Transforms/Utils/Local.h>
 using namespace std;
 
 
-Parser::Parser()
+Parser::Parser( llvm::StringRef source )
         : genContext ( "mila" ),
-          programASTNode( new ProgramASTNode() ){}
+          m_Tokens ( source ),
+          m_Diags ( source ),
+          m_Sema ( genContext.symbols, m_Diags ),
+          programASTNode( new ProgramASTNode() )
+{
+}
 
 
-const llvm::Module& Parser::Generate()
+// Folds constant branches, drops blocks nothing jumps to and merges straight-line chains of blocks
+static void CleanupCFG ( llvm::Function & function )
 {
+    for ( llvm::BasicBlock & BB : function )
+        llvm::ConstantFoldTerminator( &BB );
+
+    llvm::removeUnreachableBlocks( function );
+
+    for ( auto it = function.begin(); it != function.end(); )
+    {
+        llvm::BasicBlock * BB = &*it++;
+        llvm::MergeBlockIntoPredecessor( BB );
+    }
+}
 
+void Parser::DeclareRuntime ()
+{
     genContext.module.getOrInsertFunction("writeln", llvm::FunctionType::get(llvm::Type :: getVoidTy(genContext.ctx), true));
     genContext.module.getOrInsertFunction("write", llvm::FunctionType::get(llvm::Type :: getVoidTy(genContext.ctx), true));
     genContext.module.getOrInsertFunction("readln", llvm::FunctionType::get(llvm::Type :: getVoidTy(genContext.ctx), true));
+}
 
-    programASTNode ->codegen( genContext );
+llvm::Module & Parser::FinishModule ()
+{
+    if ( m_DebugInfo )
+        m_DebugInfo -> finish();
+
+    llvm::TimeTraceScope traceScope ( "CleanupCFG" );
+    for ( llvm::Function & function : genContext.module )
+        if ( !function.isDeclaration() )
+            CleanupCFG( function );
 
     return this->genContext . module;
 }
 
-void ParserError()
+bool Parser::Analyze()
+{
+    m_Analyzed = true;
+    m_Sema.analyze( *programASTNode );
+    return !m_Diags.hasErrors();
+}
+
+llvm::Module& Parser::Generate()
 {
-    throw std::runtime_error("Parser error occurred.");
+    // Codegen relies on the annotations of Sema, a program with semantic errors is not lowered
+    if ( !m_Analyzed )
+        Analyze();
+    if ( m_Diags.hasErrors() )
+        return genContext.module;
+
+    DeclareRuntime();
+    if ( !m_ReleaseAST )
+    {
+        programASTNode ->codegen( genContext );
+        return FinishModule();
+    }
+
+    // The memory of a lowered statement is reused for the IR of the next ones, the whole AST and
+    // the whole module are never held at the same time
+    programASTNode -> codegenEntry( genContext );
+    for ( auto & statement : programASTNode -> m_statements )
+    {
+        ProgramASTNode::codegenStatement( genContext, *statement );
+        statement.reset();
+    }
+    programASTNode -> m_statements.clear();
+    programASTNode -> codegenExit( genContext );
+    return FinishModule();
+}
+
+bool Parser::ParseAndGenerate()
+{
+    m_Streaming = true;
+    m_Tokens.runAhead();
+    DeclareRuntime();
+
+    getNextToken();
+    {
+        llvm::TimeTraceScope traceScope ( "Parser::Start" );
+        Start ();
+    }
+    m_Tokens.stop();
+    if ( m_Stats )
+        m_Stats -> addLexing( m_Tokens.lexTime(), m_Tokens.tokenCount() );
+    m_Tokens.finishRecording();
+
+    Flush ( programASTNode -> m_statements );          // the last statement, or main of an empty program
+    if ( m_Diags.hasErrors() )
+        return false;
+    {
+        CompileStats::Timer timer ( m_Stats, CompileStats::Codegen );
+        programASTNode -> codegenExit( genContext );
+        FinishModule();
+    }
+    return true;
+}
+
+// In ParseAndGenerate, analyzes and generates the top-level statements parsed so far and frees them.
+// Once there is an error nothing more is generated; after a semantic error statements are still
+// analyzed, after a syntax error only parsed on to report further errors
+void Parser::Flush ( vector<unique_ptr<StatementASTNode>> & statements )
+{
+    if ( !m_Streaming || &statements != &programASTNode -> m_statements )
+        return;
+
+    if ( m_Diags.getErrorCount() == m_SemanticErrors )
+    {
+        size_t errors = m_Diags.getErrorCount();
+        {
+            CompileStats::Timer timer ( m_Stats, CompileStats::Sema );
+            for ( const auto & statement : statements )
+            {
+                if ( m_Stats )
+                    m_Stats -> countAST( *statement );
+                m_Sema.analyzeStatement( *statement );
+            }
+        }
+        m_SemanticErrors += m_Diags.getErrorCount() - errors;
+    }
+
+    if ( !m_Diags.hasErrors() )
+    {
+        CompileStats::Timer timer ( m_Stats, CompileStats::Codegen );
+        if ( !m_MainOpen )
+        {
+            programASTNode -> codegenEntry( genContext );
+            m_MainOpen = true;
+        }
+        for ( const auto & statement : statements )
+            ProgramASTNode::codegenStatement( genContext, *statement );
+    }
+    statements.clear();
+}
+
+// Reports a syntax error at the current token. Until the parser synchronizes again at a statement
+// or declaration boundary, any further errors are only consequences of this one and are dropped
+void Parser::Unexpected ( const char * expected )
+{
+    if ( m_Panic )
+        return;
+    // A missing ';' belongs to the end of the statement before it, not to whatever comes next
+    SourceLocation loc = llvm::StringRef( expected ) == "';'" ? m_PrevEnd : m_TokLoc;
+    m_Diags.error( loc, llvm::Twine( "expected " ) + expected + ", found " + getTokenSpelling( CurTok ) );
+    m_Panic = true;
+}
+
+// Skips what is left of a broken statement or declaration: up to and including its ';',
+// or up to the next token that can only start something new
+void Parser::Synchronize ()
+{
+    while ( true )
+    {
+        switch ( CurTok )
+        {
+            case Token::tok_semicolon:
+                getNextToken();
+                m_Panic = false;
+                return;
+            case Token::tok_eof:
+            case Token::tok_begin:
+            case Token::tok_end:
+            case Token::tok_const:
+            case Token::tok_var:
+            case Token::tok_for:
+            case Token::tok_while:
+            case Token::tok_if:
+            case Token::tok_writeln:
+            case Token::tok_write:
+            case Token::tok_readln:
+            case Token::tok_break:
+            case Token::tok_continue:
+                m_Panic = false;
+                return;
+            default:
+                getNextToken();
+        }
+    }
 }
 
 int Parser::getNextToken()
 {
-    return CurTok = m_Lexer.gettok();
+    m_PrevEnd = m_Tok.end;
+
+    // A lexer running ahead on its own thread is timed there
+    if ( m_Tokens.isThreaded() )
+        m_Tokens.next( m_Tok );
+    else
+        LexToken();
+
+    CurTok = m_Tok.tok;
+    m_TokLoc = m_Tok.loc;
+    if ( m_Tok.error != nullptr )
+        m_Diags.error( m_TokLoc, m_Tok.error );
+    return CurTok;
+}
+
+void Parser::LexToken()
+{
+    if ( llvm::getTimeTraceProfilerInstance() == nullptr )
+    {
+        LexToken( m_Tok );
+        return;
+    }
+
+    if ( m_TraceNext == m_TraceLexed )
+        LexTraceBlock();
+
+    // Taken like TokenStream::next takes a token of its ring: the value of the last number or identifier stays
+    // in m_Tok, and identifier buffers are swapped, not copied
+    LexedToken & token = m_TraceBlock[m_TraceNext++];
+    m_Tok.tok = token.tok;
+    m_Tok.loc = token.loc;
+    m_Tok.end = token.end;
+    m_Tok.error = token.error;
+    if ( token.tok == tok_identifier )
+        m_Tok.identifier.swap( token.identifier );
+    else if ( token.tok == tok_number )
+        m_Tok.number = token.number;
+    else if ( token.tok == tok_real )
+        m_Tok.real = token.real;
+}
+
+void Parser::LexToken ( LexedToken & token )
+{
+    if ( m_Stats == nullptr )
+    {
+        m_Tokens.next( token );
+        return;
+    }
+
+    m_Stats -> startToken();
+    m_Tokens.next( token );
+    m_Stats -> endToken();
+}
+
+// Lexes up to TraceBlockSize tokens ahead of the parser, or up to tok_eof, as one trace event
+void Parser::LexTraceBlock ()
+{
+    llvm::TimeTraceScope traceScope ( "Lexer::gettok" );
+
+    m_TraceBlock.resize( TraceBlockSize );
+    m_TraceLexed = 0;
+    m_TraceNext = 0;
+    do
+        LexToken( m_TraceBlock[m_TraceLexed] );
+    while ( m_TraceBlock[m_TraceLexed++].tok != tok_eof && m_TraceLexed < TraceBlockSize );
 }
 
 void Parser::Match ( Token needed )
 {
     if ( CurTok != needed )
-        ParserError();
-    else
-        getNextToken();
+    {
+        Unexpected( getTokenSpelling( needed ) );
+        return;
+    }
+    // The ';' of a broken statement ends it, parsing goes on normally with the next one
+    if ( needed == Token::tok_semicolon )
+        m_Panic = false;
+    getNextToken();
+}
+
+void Parser::enableDebugInfo ( llvm::StringRef sourceName, bool optimized )
+{
+    m_DebugInfo = make_unique<DebugInfo>( genContext.module, sourceName, optimized );
+    genContext.debugInfo = m_DebugInfo.get();
 }
 
 bool Parser::Parse()
 {
     getNextToken();
-    Start ();
-    return true;
+    {
+        llvm::TimeTraceScope traceScope ( "Parser::Start" );
+        Start ();
+    }
+    m_Tokens.finishRecording();
+    return !m_Diags.hasErrors();
 }
 
 
 void Parser::Start ()
 {
     Program ( programASTNode -> nameOfProgram );
+    if ( m_Panic )
+        Synchronize();
     Const ( programASTNode -> m_statements );
     Var ( programASTNode -> m_statements );
     Body( programASTNode -> m_statements );
+    programASTNode -> m_endLoc = m_TokLoc;
     if ( CurTok != Token::tok_dot )
-        ParserError();
+        Unexpected ( "'.'" );
 }
 
 void Parser::Program(string & nameOfProgram )
@@ -62,14 +314,15 @@ void Parser::Program(string & nameOfProgram )
     {
         case Token::tok_program:
         {
+            programASTNode -> setLocation ( m_TokLoc );
             Match(Token::tok_program);
-            nameOfProgram = m_Lexer . identifierStr();
+            nameOfProgram = m_Tok.identifier;
             Match(Token::tok_identifier);
             Match(Token::tok_semicolon);
             break;
         }
         default:
-            ParserError();
+            Unexpected ( "'program'" );
     }
 }
 
@@ -91,27 +344,32 @@ void Parser::Const( vector<unique_ptr<StatementASTNode>> & consts )
 void Parser::Assign ( vector<unique_ptr<StatementASTNode>> & consts )
 {
     unique_ptr<ConstDeclASTNode> constant ( new ConstDeclASTNode () );
-    constant -> m_const = m_Lexer .identifierStr();
+    constant -> setLocation ( m_TokLoc );
+    constant -> m_const = m_Tok.identifier;
     Match ( Token::tok_identifier );
     Match ( Token::tok_equal );
-    unique_ptr<LiteralASTNode> valueOfConst ( new LiteralASTNode ( m_Lexer . numVal() ));
-    constant ->m_expr = std::move (valueOfConst);
+    constant ->m_expr = NumberLiteral ( false );
     consts . emplace_back ( std::move(constant) );
-    Match ( Token::tok_number );
     Match ( Token::tok_semicolon );
 }
 
 void Parser::NextConst ( vector<unique_ptr<StatementASTNode>> & consts )
 {
-    switch ( CurTok )
+    // One constant per iteration, a long const section does not deepen the stack
+    while ( true )
     {
-        case Token::tok_identifier: {
-            Assign ( consts );
-            NextConst ( consts );
-            break;
+        Flush ( consts );
+        if ( m_Panic )
+            Synchronize();
+
+        switch ( CurTok )
+        {
+            case Token::tok_identifier:
+                Assign ( consts );
+                break;
+            default:
+                return;
         }
-        default:
-            break;
     }
 }
 
@@ -133,22 +391,27 @@ void Parser::Var( vector<unique_ptr<StatementASTNode>> & vars  )
 
 void Parser::Declare( vector<unique_ptr<StatementASTNode>> & vars  )
 {
-    string nameOfVar = m_Lexer . identifierStr();
+    string nameOfVar = m_Tok.identifier;
+    SourceLocation loc = m_TokLoc;
     Match ( Token::tok_identifier );
 
+    // In "I, J, K : integer" the names before the last one are integers
+    while ( CurTok == Token::tok_comma )
+    {
+        unique_ptr<VarDeclASTNode> var ( new VarDeclASTNode( ) );
+        var ->m_var = nameOfVar;
+        var -> setLocation ( loc );
+        unique_ptr<TypeASTNode> type ( new TypeASTNode ( Type::INT ) );
+        var -> m_type = std::move ( type );
+        vars . emplace_back ( std::move(var) );
+        Match(Token::tok_comma);
+        nameOfVar = m_Tok.identifier;
+        loc = m_TokLoc;
+        Match ( Token::tok_identifier );
+    }
+
     switch ( CurTok )
     {
-        case Token::tok_comma:
-        {
-            unique_ptr<VarDeclASTNode> var ( new VarDeclASTNode( ) );
-            var ->m_var = nameOfVar;
-            unique_ptr<TypeASTNode> type ( new TypeASTNode ( Type::INT ) );
-            var -> m_type = std::move ( type );
-            vars . emplace_back ( std::move(var) );
-            Match(Token::tok_comma);
-            Declare ( vars );
-            break;
-        }
         case Token::tok_colon:
         {
             Match ( Token::tok_colon );
@@ -159,6 +422,7 @@ void Parser::Declare( vector<unique_ptr<StatementASTNode>> & vars  )
                 {
                     unique_ptr<VarDeclASTNode> var ( new VarDeclASTNode( ) );
                     var ->m_var = nameOfVar;
+                    var -> setLocation ( loc );
                     unique_ptr<TypeASTNode> type ( new TypeASTNode ( Type::INT ) );
                     var -> m_type = std::move ( type );
                     vars . emplace_back ( std::move(var) );
@@ -170,29 +434,13 @@ void Parser::Declare( vector<unique_ptr<StatementASTNode>> & vars  )
                 {
                     Match(Token::tok_array);
                     Match(Token::tok_squareleftparenthesis);
-                    int signLowerBound = 1;
-                    if ( CurTok == Token::tok_substract )
-                    {
-                        Match(Token::tok_substract);
-                        signLowerBound *= -1;
-                    }
-                    Match(Token::tok_number);
                     unique_ptr<ArrayDeclASTNode> array ( new ArrayDeclASTNode () );
-                    assert(!genContext.symbolTable.contains(nameOfVar));
-                    genContext.symbolTable[nameOfVar] = {nameOfVar, nullptr, nullptr,0, 0 };
                     array ->m_var = nameOfVar;
-                    array ->m_lowerBound = m_Lexer .numVal() * signLowerBound;
-                    genContext .symbolTable[nameOfVar] .offset = array -> m_lowerBound;
+                    array -> setLocation ( loc );
+                    array ->m_lowerBound = ArrayBound();
                     Match(Token::tok_dot);
                     Match(Token::tok_dot);
-                    int signUpperBound = 1;
-                    if ( CurTok == Token::tok_substract )
-                    {
-                        Match(Token::tok_substract);
-                        signUpperBound *= -1;
-                    }
-                    Match(Token::tok_number);
-                    array-> m_upperBound = m_Lexer . numVal() * signUpperBound;
+                    array-> m_upperBound = ArrayBound();
                     unique_ptr<TypeASTNode> type ( new TypeASTNode ( Type::INT ) );
                     array -> m_type = std::move ( type );
                     Match(Token::tok_squarerightparenthesis);
@@ -203,32 +451,36 @@ void Parser::Declare( vector<unique_ptr<StatementASTNode>> & vars  )
                     break;
                 }
                 default:
-                    ParserError();
+                    Unexpected ( "'integer' or 'array'" );
             }
             break;
         }
         default:
-            ParserError();
+            Unexpected ( "',' or ':'" );
     }
 }
 
 void Parser::NextVar( vector<unique_ptr<StatementASTNode>> & vars  )
 {
-    switch ( CurTok )
+    // One declaration per iteration, a long var section does not deepen the stack
+    while ( true )
     {
-        case Token::tok_identifier: {
-            Declare( vars );
-            NextVar( vars );
-            break;
-        }
-        case Token::tok_var: {
-            Match(Token::tok_var);
-            Declare( vars );
-            NextVar( vars );
-            break;
+        Flush ( vars );
+        if ( m_Panic )
+            Synchronize();
+
+        switch ( CurTok )
+        {
+            case Token::tok_identifier:
+                Declare( vars );
+                break;
+            case Token::tok_var:
+                Match(Token::tok_var);
+                Declare( vars );
+                break;
+            default:
+                return;
         }
-        default:
-            break;
     }
 }
 
@@ -242,56 +494,62 @@ void Parser::Body( vector<unique_ptr<StatementASTNode>> & statements )
 
 void Parser::Expression( vector<unique_ptr<StatementASTNode>> & statements )
 {
-
-    switch ( CurTok )
+    // One statement per iteration, so the stack only grows with nesting, not with the length of the program
+    while ( true )
     {
-        case Token::tok_identifier:
-            Assignment( statements );
-            Expression( statements );
-            break;
-        case Token::tok_for:
-            ForCycle( statements );
-            Expression( statements );
-            break;
-        case Token::tok_while:
-            WhileCycle(statements);
-            Expression( statements );
-            break;
-        case Token::tok_if:
-            If( statements );
-            Expression( statements );
-            break;
-        case Token::tok_writeln:
-            Writeln ( statements );
-            Expression(statements);
-            break;
-        case Token::tok_write:
-            Write ( statements );
-            Expression(statements);
-            break;
-        case Token::tok_readln:
-            Readln ( statements );
-            Expression(statements);
-            break;
-        case Token::tok_break:
+        Flush ( statements );
+        // A broken statement is skipped here and the next one parsed
+        if ( m_Panic )
+            Synchronize();
+
+        switch ( CurTok )
         {
-            Match(Token::tok_break);
-            Match(Token::tok_semicolon);
-            unique_ptr<BreakASTNode> breakNode ( new BreakASTNode () );
-            statements .emplace_back(std::move(breakNode));
-            Expression( statements );
-            break;
+            case Token::tok_identifier:
+                Assignment( statements );
+                break;
+            case Token::tok_for:
+                ForCycle( statements );
+                break;
+            case Token::tok_while:
+                WhileCycle(statements);
+                break;
+            case Token::tok_if:
+                If( statements );
+                break;
+            case Token::tok_writeln:
+                Writeln ( statements );
+                break;
+            case Token::tok_write:
+                Write ( statements );
+                break;
+            case Token::tok_readln:
+                Readln ( statements );
+                break;
+            case Token::tok_break:
+                Break( statements );
+                break;
+            case Token::tok_continue:
+                Continue( statements );
+                break;
+            case Token::tok_end:
+            case Token::tok_dot:
+            case Token::tok_eof:
+                return;
+            default:
+                // Skip at least this token, it may be one Synchronize stops at
+                Unexpected ( "statement" );
+                getNextToken();
         }
-        default:
-            break;
     }
 }
 
 void Parser::ForCycle( vector<unique_ptr<StatementASTNode>> & statements )
 {
+    SourceLocation loc = m_TokLoc;
     unique_ptr<ForASTNode> forNode ( new ForASTNode () );
     Match(Token::tok_for);
-    string nameOfVar = m_Lexer . identifierStr();
+    string nameOfVar = m_Tok.identifier;
+    SourceLocation varLoc = m_TokLoc;
 
     switch ( CurTok )
     {
@@ -307,6 +565,7 @@ void Parser::ForCycle( vector<unique_ptr<StatementASTNode>> & statements )
                 {
                     unique_ptr<DeclArrayRefASTNode> array ( new DeclArrayRefASTNode () );
                     array ->m_var = nameOfVar;
+                    array -> setLocation ( varLoc );
                     Match(Token::tok_squareleftparenthesis);
                     array -> m_index = std::move(ArithmeticExpression());
                     Match(Token::tok_squarerightparenthesis);
@@ -316,6 +575,7 @@ void Parser::ForCycle( vector<unique_ptr<StatementASTNode>> & statements )
                 default:
                 {
                     unique_ptr<DeclRefASTNode> var ( new DeclRefASTNode (nameOfVar) );
+                    var -> setLocation ( varLoc );
                     assignment ->m_var= std::move(var);
                     break;
                 }
@@ -326,7 +586,7 @@ void Parser::ForCycle( vector<unique_ptr<StatementASTNode>> & statements )
             break;
         }
         default:
-            ParserError();
+            Unexpected ( "identifier" );
     }
 
 
@@ -337,9 +597,11 @@ void Parser::ForCycle( vector<unique_ptr<StatementASTNode>> & statements )
             Match(Token::tok_to);
             unique_ptr<AssignASTNode> increment ( new AssignASTNode () );
             unique_ptr<DeclRefASTNode> var ( new DeclRefASTNode(nameOfVar));
+            var -> setLocation ( varLoc );
             increment -> m_var = std::move(var);
             unique_ptr<BinOpASTNode> plusOne ( new BinOpASTNode (Token::tok_sum));
             unique_ptr<DeclRefASTNode> var2 ( new DeclRefASTNode(nameOfVar));
+            var2 -> setLocation ( varLoc );
             plusOne -> m_rhs = std::move(var2);
             unique_ptr<LiteralASTNode> one ( new LiteralASTNode (1));
             plusOne -> m_lhs = std::move ( one );
@@ -352,9 +614,11 @@ void Parser::ForCycle( vector<unique_ptr<StatementASTNode>> & statements )
             Match(Token::tok_downto);
             unique_ptr<AssignASTNode> decrement ( new AssignASTNode () );
             unique_ptr<DeclRefASTNode> var ( new DeclRefASTNode(nameOfVar));
+            var -> setLocation ( varLoc );
             decrement -> m_var = std::move(var);
             unique_ptr<BinOpASTNode> plusOne ( new BinOpASTNode (Token::tok_substract));
             unique_ptr<DeclRefASTNode> var2 ( new DeclRefASTNode(nameOfVar));
+            var2 -> setLocation ( varLoc );
             plusOne -> m_lhs = std::move(var2);
             unique_ptr<LiteralASTNode> one ( new LiteralASTNode (1));
             plusOne -> m_rhs = std::move ( one );
@@ -363,11 +627,12 @@ void Parser::ForCycle( vector<unique_ptr<StatementASTNode>> & statements )
             break;
         }
         default:
-            ParserError();
+            Unexpected ( "'to' or 'downto'" );
     }
 
     unique_ptr<BinOpASTNode> condition ( new BinOpASTNode (Token::tok_notequal));
     unique_ptr<DeclRefASTNode> var ( new DeclRefASTNode(nameOfVar));
+    var -> setLocation ( varLoc );
     condition -> m_lhs = std::move ( var );
     condition -> m_rhs = std::move(ArithmeticExpression());
     forNode ->m_condition = std::move ( condition );
@@ -395,25 +660,25 @@ void Parser::ForCycle( vector<unique_ptr<StatementASTNode>> & statements )
             Write(forNode -> m_body);
             break;
         case Token::tok_break:
-        {
-            Match(Token::tok_break);
-            Match(Token::tok_semicolon);
-            unique_ptr<BreakASTNode> breakNode ( new BreakASTNode () );
-            statements .emplace_back(std::move(breakNode));
+            Break(forNode -> m_body);
+            break;
+        case Token::tok_continue:
+            Continue(forNode -> m_body);
             break;
-        }
         case Token::tok_begin:
             Body(forNode -> m_body);
             Match(Token::tok_semicolon);
             break;
         default:
-            ParserError();
+            Unexpected ( "statement" );
     }
+    forNode -> setLocation ( loc );
     statements .emplace_back(std::move(forNode));
 }
 
 void Parser::WhileCycle( vector<unique_ptr<StatementASTNode>> & statements )
 {
+    SourceLocation loc = m_TokLoc;
     unique_ptr<WhileASTNode> whileNode ( new WhileASTNode () );
     Match(Token::tok_while);
     whileNode->m_cond = std::move (ArithmeticExpression());
@@ -441,24 +706,24 @@ void Parser::WhileCycle( vector<unique_ptr<StatementASTNode>> & statements )
             Write(whileNode -> m_body);
             break;
         case Token::tok_break:
-        {
-            Match(Token::tok_break);
-            Match(Token::tok_semicolon);
-            unique_ptr<BreakASTNode> breakNode ( new BreakASTNode () );
-            statements .emplace_back(std::move(breakNode));
+            Break(whileNode -> m_body);
+            break;
+        case Token::tok_continue:
+            Continue(whileNode -> m_body);
             break;
-        }
         case Token::tok_begin:
             Body(whileNode -> m_body);
             Match(Token::tok_semicolon);
             break;
         default:
-            ParserError();
+            Unexpected ( "statement" );
     }
+    whileNode -> setLocation ( loc );
     statements .emplace_back(std::move(whileNode));
 }
 
 void Parser::If ( vector<unique_ptr<StatementASTNode>> & statements ) {
+    SourceLocation loc = m_TokLoc;
     Match(Token::tok_if);
     unique_ptr<IfASTNode> ifNode ( new IfASTNode () );
     ifNode -> m_cond = std::move (ArithmeticExpression());
@@ -486,19 +751,17 @@ void Parser::If ( vector<unique_ptr<StatementASTNode>> & statements ) {
             Readln(ifNode ->m_bodyTrue);
             break;
         case Token::tok_break:
-        {
-            Match(Token::tok_break);
-            Match(Token::tok_semicolon);
-            unique_ptr<BreakASTNode> breakNode ( new BreakASTNode () );
-            ifNode ->m_bodyTrue .emplace_back(std::move(breakNode));
+            Break(ifNode ->m_bodyTrue);
+            break;
+        case Token::tok_continue:
+            Continue(ifNode ->m_bodyTrue);
             break;
-        }
         case Token::tok_begin:
             Body(ifNode ->m_bodyTrue);
             Match(Token::tok_semicolon);
             break;
         default:
-            ParserError();
+            Unexpected ( "statement" );
     }
     if ( CurTok == Token::tok_else )
     {
@@ -526,21 +789,20 @@ void Parser::If ( vector<unique_ptr<StatementASTNode>> & statements ) {
                 Readln(ifNode ->m_bodyFalse);
                 break;
             case Token::tok_break:
-            {
-                Match(Token::tok_break);
-                Match(Token::tok_semicolon);
-                unique_ptr<BreakASTNode> breakNode ( new BreakASTNode () );
-                ifNode ->m_bodyFalse .emplace_back(std::move(breakNode));
+                Break(ifNode ->m_bodyFalse);
+                break;
+            case Token::tok_continue:
+                Continue(ifNode ->m_bodyFalse);
                 break;
-            }
             case Token::tok_begin:
                 Body(ifNode ->m_bodyFalse);
                 Match(Token::tok_semicolon);
                 break;
             default:
-                ParserError();
+                Unexpected ( "statement" );
         }
     }
+    ifNode -> setLocation ( loc );
     statements .emplace_back(std::move(ifNode));
 }
 
@@ -552,7 +814,8 @@ void Parser::Assignment( vector<unique_ptr<StatementASTNode>> & statements )
     {
         case Token::tok_identifier: {
             unique_ptr<AssignASTNode> assignment ( new AssignASTNode () );
-            string nameOfVar = m_Lexer . identifierStr();
+            assignment -> setLocation ( m_TokLoc );
+            string nameOfVar = m_Tok.identifier;
             Match(Token::tok_identifier);
             switch ( CurTok )
             {
@@ -561,22 +824,8 @@ void Parser::Assignment( vector<unique_ptr<StatementASTNode>> & statements )
                     Match(Token::tok_squareleftparenthesis);
                     unique_ptr<DeclArrayRefASTNode> array ( new DeclArrayRefASTNode () );
                     array -> m_var = nameOfVar;
-                    if ( CurTok == Token::tok_substract)
-                    {
-                        Match(Token::tok_substract);
-                        assert(genContext.symbolTable.contains(nameOfVar));
-                        unique_ptr<LiteralASTNode> number ( new LiteralASTNode ( m_Lexer . numVal() - genContext.symbolTable[nameOfVar] .offset ) );
-                        array -> m_index = std::move( number );
-                        Match(Token::tok_number);
-                    } else
-                    {
-                        unique_ptr<BinOpASTNode> plusOffset ( new BinOpASTNode ( Token::tok_substract ));
-                        assert(genContext.symbolTable.contains(nameOfVar));
-                        unique_ptr<LiteralASTNode> number ( new LiteralASTNode ( genContext.symbolTable[nameOfVar] .offset ) );
-                        plusOffset ->m_rhs = std::move(number);
-                        plusOffset -> m_lhs = std::move ( ArithmeticExpression());
-                        array -> m_index = std::move(plusOffset);
-                    }
+                    array -> setLocation ( assignment -> getLocation() );
+                    array -> m_index = std::move ( ArithmeticExpression() );
                     Match(Token::tok_squarerightparenthesis);
                     assignment ->m_var = std::move(array);
                     break;
@@ -584,6 +833,7 @@ void Parser::Assignment( vector<unique_ptr<StatementASTNode>> & statements )
                 default:
                 {
                     unique_ptr<DeclRefASTNode> var ( new DeclRefASTNode ( nameOfVar) );
+                    var -> setLocation ( assignment -> getLocation() );
                     assignment -> m_var = std::move(var);
                 }
             }
@@ -595,7 +845,7 @@ void Parser::Assignment( vector<unique_ptr<StatementASTNode>> & statements )
             break;
         }
         default:
-            ParserError();
+            Unexpected ( "identifier" );
     }
 }
 
@@ -606,418 +856,116 @@ unique_ptr<AssignASTNode> Parser::Assignment()
         case Token::tok_identifier: {
             unique_ptr<AssignASTNode> assignment ( new AssignASTNode () );
             Match(Token::tok_identifier);
-            unique_ptr<DeclRefASTNode> var ( new DeclRefASTNode ( m_Lexer.identifierStr()) );
+            unique_ptr<DeclRefASTNode> var ( new DeclRefASTNode ( m_Tok.identifier) );
             assignment ->m_var= std::move(var);
             Match(Token::tok_assign);
             assignment -> m_expr = std::move( ArithmeticExpression() );
             break;
         }
         default:
-            ParserError();
+            Unexpected ( "identifier" );
     }
     return nullptr;
 }
 
-unique_ptr<ExprASTNode> Parser::ArithmeticExpression()
+// How tightly a binary operator binds, 0 for tokens that are not one
+static int BinaryPrecedence ( int tok )
 {
-    switch( CurTok )
+    switch ( tok )
     {
-        case Token::tok_leftparenthesis:
-        case Token::tok_number:
-        case Token::tok_identifier:
-        case Token::tok_not:
-        {
-
-            unique_ptr<ExprASTNode> expression = std::move(L5());
-            unique_ptr<BinOpASTNode> binaryExpr = std::move(L6p());
-            if ( binaryExpr == nullptr )
-                return expression;
-            else
-            {
-                binaryExpr -> m_lhs = std::move(expression);
-                return binaryExpr;
-            }
-        }
+        case Token::tok_multiply:
+        case Token::tok_mod:
+        case Token::tok_div:
+            return 5;
+        case Token::tok_sum:
         case Token::tok_substract:
-        {
-            Match(Token::tok_substract);
-            unique_ptr<LiteralASTNode> number ( new LiteralASTNode (m_Lexer .numVal() * -1));
-            Match(Token::tok_number);
-            return number;
-        }
-        default:
-            ParserError();
-    }
-    return nullptr;
-}
-
-unique_ptr<BinOpASTNode> Parser::L6p()
-{
-    switch( CurTok )
-    {
+            return 4;
+        case Token::tok_greater:
+        case Token::tok_less:
+        case Token::tok_greaterequal:
+        case Token::tok_lessequal:
+            return 3;
+        case Token::tok_equal:
+        case Token::tok_notequal:
+            return 2;
         case Token::tok_or:
-        {
-
-            Match(Token::tok_or);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_or ) );
-            unique_ptr<ExprASTNode> expression = std::move(L5());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L6p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
         case Token::tok_and:
-        {
-            Match(Token::tok_and);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_and ) );
-            unique_ptr<ExprASTNode> expression = std::move(L5());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L6p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
         case Token::tok_xor:
-        {
-            Match(Token::tok_xor);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_xor ) );
-            unique_ptr<ExprASTNode> expression = std::move(L5());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L6p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
+            return 1;
         default:
-            return nullptr;
+            return 0;
     }
 }
 
-unique_ptr<ExprASTNode> Parser::L5()
+unique_ptr<ExprASTNode> Parser::ArithmeticExpression()
 {
-    switch( CurTok )
+    // A negative number may only start an expression
+    if ( CurTok == Token::tok_substract )
     {
-        case Token::tok_leftparenthesis:
-        case Token::tok_number:
-        case Token::tok_identifier:
-        case Token::tok_not:
-        {
-            unique_ptr<ExprASTNode> expression = std::move(L4());
-            unique_ptr<BinOpASTNode> binaryExpr = std::move(L5p());
-            if ( binaryExpr == nullptr )
-                return expression;
-            else
-            {
-                binaryExpr -> m_lhs = std::move(expression);
-                return binaryExpr;
-            }
-        }
-        default:
-            ParserError();
+        Match(Token::tok_substract);
+        return BinaryExpression ( NumberLiteral ( true ), 1 );
     }
-    return nullptr;
+    return BinaryExpression ( Primary(), 1 );
 }
 
-unique_ptr<BinOpASTNode> Parser::L5p()
+// Precedence climbing: folds the operators that bind at least as tightly as minPrecedence into lhs.
+// Operators of one level associate to the left, and the recursion is only as deep as there are levels
+unique_ptr<ExprASTNode> Parser::BinaryExpression ( unique_ptr<ExprASTNode> lhs, int minPrecedence )
 {
-    switch( CurTok )
+    while ( true )
     {
-        case Token::tok_equal:
-        {
-            Match(Token::tok_equal);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_equal ) );
-            unique_ptr<ExprASTNode> expression = std::move(L4());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L5p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
-        case Token::tok_notequal:
-        {
-            Match(Token::tok_notequal);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_notequal ) );
-            unique_ptr<ExprASTNode> expression = std::move(L4());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L5p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
-        default:
-            return nullptr;
-    }
-}
+        int precedence = BinaryPrecedence( CurTok );
+        if ( precedence < minPrecedence )
+            return lhs;
 
-unique_ptr<ExprASTNode> Parser::L4()
-{
-    switch( CurTok )
-    {
-        case Token::tok_leftparenthesis:
-        case Token::tok_number:
-        case Token::tok_identifier:
-        case Token::tok_not:
-        {
-            unique_ptr<ExprASTNode> expression = std::move(L3());
-            unique_ptr<BinOpASTNode> binaryExpr = std::move(L4p());
-            if ( binaryExpr == nullptr )
-                return expression;
-            else
-            {
-                binaryExpr -> m_lhs = std::move(expression);
-                return binaryExpr;
-            }
-        }
-        default:
-            ParserError();
-    }
-    return nullptr;
-}
+        Token op = CurTok;
+        getNextToken();
+        unique_ptr<ExprASTNode> rhs = Primary();
 
-unique_ptr<BinOpASTNode> Parser::L4p()
-{
-    switch( CurTok ) {
-        case Token::tok_greater:
-        {
-            Match(Token::tok_greater);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_greater ) );
-            unique_ptr<ExprASTNode> expression = std::move(L3());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L4p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
-        case Token::tok_less:
-        {
-            Match(Token::tok_less);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_less ) );
-            unique_ptr<ExprASTNode> expression = std::move(L3());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L4p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
-        case Token::tok_greaterequal:
-        {
-            Match(Token::tok_greaterequal);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_greaterequal ) );
-            unique_ptr<ExprASTNode> expression = std::move(L3());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L4p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
-        case Token::tok_lessequal:
-        {
-            Match(Token::tok_lessequal);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_lessequal ) );
-            unique_ptr<ExprASTNode> expression = std::move(L3());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L4p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
-        default:
-            return nullptr;
-    }
-}
+        // An operator binding tighter than op takes rhs as its left operand first
+        while ( BinaryPrecedence( CurTok ) > precedence )
+            rhs = BinaryExpression ( std::move(rhs), precedence + 1 );
 
-unique_ptr<ExprASTNode> Parser::L3()
-{
-    switch( CurTok ) {
-        case Token::tok_leftparenthesis:
-        case Token::tok_number:
-        case Token::tok_identifier:
-        case Token::tok_not:
-        {
-            unique_ptr<ExprASTNode> expression = std::move(L2());
-            unique_ptr<BinOpASTNode> binaryExpr = std::move(L3p());
-            if ( binaryExpr == nullptr )
-                return expression;
-            else
-            {
-                binaryExpr -> m_lhs = std::move(expression);
-                return binaryExpr;
-            }
-        }
-        default:
-            ParserError();
+        lhs = make_unique<BinOpASTNode>( op, std::move(lhs), std::move(rhs) );
     }
-    return nullptr;
 }
 
-unique_ptr<BinOpASTNode> Parser::L3p()
+int Parser::ArrayBound ()
 {
-    switch(CurTok) {
-        case Token::tok_sum:
-        {
-            Match(Token::tok_sum);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_sum ) );
-            unique_ptr<ExprASTNode> expression = std::move(L2());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L3p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
-        case Token::tok_substract:
-        {
-            Match(Token::tok_substract);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_substract ) );
-            unique_ptr<ExprASTNode> expression = std::move(L2());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L3p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
-        default:
-            return nullptr;
+    bool negative = false;
+    if ( CurTok == Token::tok_substract )
+    {
+        Match(Token::tok_substract);
+        negative = true;
     }
-}
+    SourceLocation loc = m_TokLoc;
+    Match(Token::tok_number);
+    int64_t bound = negative ? -m_Tok.number : m_Tok.number;
 
-unique_ptr<ExprASTNode> Parser::L2()
-{
-    switch(CurTok) {
-        case Token::tok_leftparenthesis:
-        case Token::tok_number:
-        case Token::tok_identifier:
-        case Token::tok_not:
-        {
-            unique_ptr<ExprASTNode> expression = std::move(L1());
-            unique_ptr<BinOpASTNode> binaryExpr = std::move(L2p());
-            if ( binaryExpr == nullptr )
-                return expression;
-            else
-            {
-                binaryExpr -> m_lhs = std::move(expression);
-                return binaryExpr;
-            }
-        }
-        default:
-            ParserError();
+    // Bounds are integers, a larger number is not narrowed into one
+    if ( bound < INT32_MIN || bound > INT32_MAX )
+    {
+        m_Diags.error( loc, "array bound " + llvm::Twine( bound ) + " does not fit in an integer" );
+        return 0;
     }
-    return nullptr;
+    return static_cast<int>( bound );
 }
 
-unique_ptr<BinOpASTNode> Parser::L2p()
+unique_ptr<ExprASTNode> Parser::NumberLiteral ( bool negative )
 {
-    switch( CurTok ) {
-        case Token::tok_multiply:
-        {
-            Match(Token::tok_multiply);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_multiply ) );
-            unique_ptr<ExprASTNode> expression = std::move(L1());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L2p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
-        case Token::tok_mod:
-        {
-            Match(Token::tok_mod);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_mod ) );
-            unique_ptr<ExprASTNode> expression = std::move(L1());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L2p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
-        case Token::tok_div:
-        {
-            Match(Token::tok_div);
-            unique_ptr<BinOpASTNode> binaryExpr ( new  BinOpASTNode ( Token::tok_div ) );
-            unique_ptr<ExprASTNode> expression = std::move(L1());
-            unique_ptr<BinOpASTNode> binaryExprLow = std::move(L2p());
-            if ( binaryExprLow == nullptr )
-            {
-                binaryExpr -> m_rhs = std::move(expression);
-            } else
-            {
-                binaryExprLow -> m_lhs = std::move(expression);
-                binaryExpr -> m_rhs = std::move(binaryExprLow);
-            }
-            return binaryExpr;
-        }
-        default:
-            return nullptr;
+    if ( CurTok == Token::tok_real )
+    {
+        unique_ptr<FloatLiteralASTNode> real ( new FloatLiteralASTNode ( negative ? -m_Tok.real : m_Tok.real ) );
+        Match(Token::tok_real);
+        return real;
     }
+    unique_ptr<LiteralASTNode> number ( new LiteralASTNode ( negative ? -m_Tok.number : m_Tok.number ) );
+    number -> setLocation ( m_TokLoc );
+    Match(Token::tok_number);
+    return number;
 }
 
-
-unique_ptr<ExprASTNode> Parser::L1()
+unique_ptr<ExprASTNode> Parser::Primary()
 {
     switch(CurTok) {
         case Token::tok_leftparenthesis:
@@ -1028,14 +976,12 @@ unique_ptr<ExprASTNode> Parser::L1()
             return expr;
         }
         case Token::tok_number:
-        {
-            unique_ptr<LiteralASTNode> number ( new LiteralASTNode (m_Lexer .numVal() ) );
-            Match(Token::tok_number);
-            return number;
-        }
+        case Token::tok_real:
+            return NumberLiteral ( false );
         case Token::tok_identifier:
         {
-            string nameOfVar = m_Lexer . identifierStr();
+            string nameOfVar = m_Tok.identifier;
+            SourceLocation loc = m_TokLoc;
             Match(Token::tok_identifier);
             switch ( CurTok )
             {
@@ -1043,29 +989,16 @@ unique_ptr<ExprASTNode> Parser::L1()
                 {
                     unique_ptr<DeclArrayRefASTNode> array ( new DeclArrayRefASTNode () );
                     array ->m_var = nameOfVar;
+                    array -> setLocation ( loc );
                     Match(Token::tok_squareleftparenthesis);
-                    if ( CurTok == Token::tok_substract)
-                    {
-                        Match(Token::tok_substract);
-                        assert(genContext.symbolTable.contains(nameOfVar));
-                        unique_ptr<LiteralASTNode> number ( new LiteralASTNode ( m_Lexer . numVal() - genContext.symbolTable[nameOfVar] .offset ) );
-                        array -> m_index = std::move( number );
-                        Match(Token::tok_number);
-                    } else
-                    {
-                        unique_ptr<BinOpASTNode> plusOffset ( new BinOpASTNode ( Token::tok_substract ));
-                        assert(genContext.symbolTable.contains(nameOfVar));
-                        unique_ptr<LiteralASTNode> number ( new LiteralASTNode ( genContext.symbolTable[nameOfVar] .offset ) );
-                        plusOffset ->m_rhs = std::move(number);
-                        plusOffset -> m_lhs = std::move ( ArithmeticExpression());
-                        array -> m_index = std::move(plusOffset);
-                    }
+                    array -> m_index = std::move ( ArithmeticExpression() );
                     Match(Token::tok_squarerightparenthesis);
                     return array;
                 }
                 default:
                 {
                     unique_ptr<DeclRefASTNode> var ( new DeclRefASTNode ( nameOfVar ) );
+                    var -> setLocation ( loc );
                     return var;
                 }
             }
@@ -1073,11 +1006,11 @@ unique_ptr<ExprASTNode> Parser::L1()
         case Token::tok_not:
         {
             Match(Token::tok_not);
-            unique_ptr<UnaryOpASTNode> expr ( new UnaryOpASTNode (Token::tok_not, L1()));
+            unique_ptr<UnaryOpASTNode> expr ( new UnaryOpASTNode (Token::tok_not, Primary()));
             return expr;
         }
         default:
-            ParserError();
+            Unexpected ( "expression" );
     }
     return nullptr;
 }
@@ -1085,10 +1018,12 @@ unique_ptr<ExprASTNode> Parser::L1()
 
 void Parser::Writeln(vector<unique_ptr<StatementASTNode>> &statements)
 {
+    SourceLocation loc = m_TokLoc;
     Match(Token::tok_writeln);
     Match(Token::tok_leftparenthesis);
     unique_ptr<FunCallASTNode> func ( new FunCallASTNode( "writeln") );
     func -> m_Exprs .emplace_back(ArithmeticExpression());
+    func -> setLocation ( loc );
     statements .emplace_back(std::move(func));
     Match(Token::tok_rightparenthesis);
     Match(Token::tok_semicolon);
@@ -1096,21 +1031,45 @@ void Parser::Writeln(vector<unique_ptr<StatementASTNode>> &statements)
 
 void Parser::Write(vector<unique_ptr<StatementASTNode>> &statements)
 {
+    SourceLocation loc = m_TokLoc;
     Match(Token::tok_write);
     Match(Token::tok_leftparenthesis);
     unique_ptr<FunCallASTNode> func ( new FunCallASTNode( "write") );
     func -> m_Exprs .emplace_back(ArithmeticExpression());
+    func -> setLocation ( loc );
     statements .emplace_back(std::move(func));
     Match(Token::tok_rightparenthesis);
     Match(Token::tok_semicolon);
 }
 
+void Parser::Break(vector<unique_ptr<StatementASTNode>> &statements)
+{
+    SourceLocation loc = m_TokLoc;
+    Match(Token::tok_break);
+    Match(Token::tok_semicolon);
+    unique_ptr<BreakASTNode> breakNode ( new BreakASTNode () );
+    breakNode -> setLocation ( loc );
+    statements .emplace_back(std::move(breakNode));
+}
+
+void Parser::Continue(vector<unique_ptr<StatementASTNode>> &statements)
+{
+    SourceLocation loc = m_TokLoc;
+    Match(Token::tok_continue);
+    Match(Token::tok_semicolon);
+    unique_ptr<ContinueASTNode> continueNode ( new ContinueASTNode () );
+    continueNode -> setLocation ( loc );
+    statements .emplace_back(std::move(continueNode));
+}
+
 void Parser::Readln(vector<unique_ptr<StatementASTNode>> &statements)
 {
+    SourceLocation loc = m_TokLoc;
     Match(Token::tok_readln);
     Match(Token::tok_leftparenthesis);
     unique_ptr<FunCallASTNode> func ( new FunCallASTNode( "readln") );
-    string nameOfVar = m_Lexer .identifierStr();
+    string nameOfVar = m_Tok.identifier;
+    SourceLocation varLoc = m_TokLoc;
     Match(Token::tok_identifier);
 
     switch ( CurTok )
@@ -1120,6 +1079,7 @@ void Parser::Readln(vector<unique_ptr<StatementASTNode>> &statements)
             Match(Token::tok_squareleftparenthesis);
             unique_ptr<DeclArrayRefASTNode> array ( new DeclArrayRefASTNode ( ));
             array ->m_var = nameOfVar;
+            array -> setLocation ( varLoc );
             array -> m_index = std::move ( ArithmeticExpression() );
             func -> m_Refs .emplace_back(std::move(array));
             Match(Token::tok_squarerightparenthesis);
@@ -1129,10 +1089,12 @@ void Parser::Readln(vector<unique_ptr<StatementASTNode>> &statements)
         default:
         {
             unique_ptr<DeclRefASTNode> var ( new  DeclRefASTNode ( nameOfVar ) );
+            var -> setLocation ( varLoc );
             Match(Token::tok_rightparenthesis);
             func -> m_Refs .emplace_back(std::move(var));
         }
     }
+    func -> setLocation ( loc );
     statements .emplace_back(std::move(func));
     Match(Token::tok_semicolon);
 }
\ No newline at end of file
@@ -14,8 +14,12 @@
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
 
+#include "Diagnostics.h"
 #include "Lexer.h"
+#include "Sema.h"
 #include "ast.h"
+#include "Stats.h"
+#include "TokenStream.h"
 
 #include <memory>
 using namespace std;
@@ -23,22 +27,71 @@ using namespace std;
 
 class Parser {
 public:
-    Parser();
+    explicit Parser( llvm::StringRef source );
     ~Parser() = default;
 
     bool Parse();                    // parse
-    const llvm::Module& Generate();  // generate
+    bool Analyze();                  // resolve names and types, Generate runs it first if it was not called
+    llvm::Module& Generate();        // generate
+    // Pipelined Parse and Generate: the lexer runs ahead on its own thread and every top-level statement
+    // is generated and freed as soon as it is parsed, getProgram() keeps no statements
+    bool ParseAndGenerate();
+    llvm::Module& getModule() { return genContext.module; }
+
+    void setStats ( CompileStats * stats ) { m_Stats = stats; }
+    // Generate frees every top-level statement once it is lowered, getProgram() keeps no statements after it
+    void setReleaseAST ( bool release ) { m_ReleaseAST = release; }
+    void setProfile ( BranchProfile * profile ) { genContext.profile = profile; }
+    void setLineProfile ( LineProfile * profile ) { genContext.lineProfile = profile; }
+    // Records every token of the source, up to tok_eof even after the final '.' or a syntax error
+    void setTokenRecorder ( TokenWriter * recorder ) { m_Tokens.record( recorder ); }
+    // Parses tokens of an earlier recording instead of lexing the source
+    void setTokenReplay ( TokenReader * replay ) { m_Tokens.replay( replay ); }
+    // Describes the generated code in DWARF, sourceName is the file debuggers show
+    void enableDebugInfo ( llvm::StringRef sourceName, bool optimized );
+    const ProgramASTNode & getProgram() const { return *programASTNode; }
+    // Generate lowers this program instead of parsing the source, e.g. one loaded from an AST file
+    void setProgram ( unique_ptr<ProgramASTNode> program ) { programASTNode = std::move( program ); }
+    // Syntax errors of Parse and semantic errors of Analyze
+    const Diagnostics & getDiagnostics() const { return m_Diags; }
 
 private:
     int getNextToken();
+    void LexToken();
+    void LexToken ( LexedToken & token );
+    void LexTraceBlock ();
     void Match ( Token needed );
+    void Unexpected ( const char * expected );
+    void Synchronize ();
+    void DeclareRuntime ();
+    llvm::Module & FinishModule ();
+    void Flush ( vector<unique_ptr<StatementASTNode>> & statements );
 
     GenContext genContext;
 
-    Lexer m_Lexer;                   // lexer is used to read tokens
+    TokenStream m_Tokens;            // lexer is used to read tokens
+    Diagnostics m_Diags;
+    Sema m_Sema;                       // keeps the declarations of the statements analyzed so far
+    bool m_Panic = false;              // after a syntax error, until the parser gets back to a statement boundary
     Token CurTok;                      // to keep the current token
+    LexedToken m_Tok;                  // its identifier or value
+    SourceLocation m_TokLoc;           // where CurTok starts
+    SourceLocation m_PrevEnd;          // just past the token before CurTok
+
+    // While a time trace is recorded, tokens are lexed in blocks so that the trace has one event per block
+    static constexpr size_t TraceBlockSize = 4096;
+    vector<LexedToken> m_TraceBlock;
+    size_t m_TraceLexed = 0;           // tokens in m_TraceBlock
+    size_t m_TraceNext = 0;            // the next one the parser takes
 
     unique_ptr<ProgramASTNode> programASTNode;
+    CompileStats * m_Stats = nullptr;  // counts and times tokens when set
+    unique_ptr<DebugInfo> m_DebugInfo; // set by enableDebugInfo
+    bool m_ReleaseAST = false;
+    bool m_Streaming = false;          // in ParseAndGenerate
+    bool m_Analyzed = false;
+    bool m_MainOpen = false;           // codegen of the streamed statements has begun
+    size_t m_SemanticErrors = 0;       // reported while analyzing streamed statements
 
 
 
@@ -54,6 +107,8 @@ private:
     void Var ( vector<unique_ptr<StatementASTNode>> & vars );
     void NextVar ( vector<unique_ptr<StatementASTNode>> & vars );
     void Declare ( vector<unique_ptr<StatementASTNode>> & vars );
+    // An optionally negative number, the bound of an array
+    int ArrayBound ();
 
 
     void Body ( vector<unique_ptr<StatementASTNode>> & statements );
@@ -64,16 +119,10 @@ private:
 
     // Arithmetic Expression
     unique_ptr<ExprASTNode> ArithmeticExpression();
-    unique_ptr<ExprASTNode> L1 ();
-    unique_ptr<ExprASTNode> L2 ();
-    unique_ptr<BinOpASTNode> L2p();
-    unique_ptr<ExprASTNode> L3 ();
-    unique_ptr<BinOpASTNode> L3p();
-    unique_ptr<ExprASTNode> L4 ();
-    unique_ptr<BinOpASTNode> L4p();
-    unique_ptr<ExprASTNode> L5 ();
-    unique_ptr<BinOpASTNode> L5p();
-    unique_ptr<BinOpASTNode> L6p();
+    unique_ptr<ExprASTNode> BinaryExpression ( unique_ptr<ExprASTNode> lhs, int minPrecedence );
+    unique_ptr<ExprASTNode> Primary ();
+    // A number or a real number, negated if `negative`
+    unique_ptr<ExprASTNode> NumberLiteral ( bool negative );
 
     // Readln, Write and Writeln
     void Writeln ( vector<unique_ptr<StatementASTNode>> & statements );
@@ -84,6 +133,8 @@ private:
     // Cycles
     void ForCycle( vector<unique_ptr<StatementASTNode>> & statements );
     void WhileCycle( vector<unique_ptr<StatementASTNode>> & statements );
+    void Break( vector<unique_ptr<StatementASTNode>> & statements );
+    void Continue( vector<unique_ptr<StatementASTNode>> & statements );
     unique_ptr<AssignASTNode> Assignment();
 
     // If
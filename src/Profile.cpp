@@ -0,0 +1,281 @@
+#include "Profile.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/ProfileSummary.h>
+#include <llvm/ProfileData/InstrProf.h>
+#include <llvm/ProfileData/ProfileCommon.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+static const char* const ProfileMagic = "mila-profile";
+static const unsigned ProfileVersion = 1;
+
+llvm::GlobalVariable* CounterArray::create(llvm::Module& module, unsigned size)
+{
+    llvm::ArrayType* type = llvm::ArrayType::get(llvm::Type::getInt64Ty(module.getContext()), size);
+    // Mila programs are always executables, the local-exec model makes a thread-local access one instruction
+    return new llvm::GlobalVariable(module, type, false, llvm::GlobalValue::InternalLinkage, llvm::ConstantAggregateZero::get(type),
+                                    m_name, nullptr,
+                                    m_threadLocal ? llvm::GlobalValue::LocalExecTLSModel : llvm::GlobalValue::NotThreadLocal);
+}
+
+void CounterArray::increment(llvm::IRBuilder<>& builder, unsigned index)
+{
+    if (m_array == nullptr)
+        m_array = create(*builder.GetInsertBlock()->getModule(), 0);
+
+    llvm::Value* ptr = builder.CreateConstGEP2_64(m_array->getValueType(), m_array, 0, index, "prof.ptr");
+    llvm::Value* value = builder.CreateLoad(builder.getInt64Ty(), ptr, "prof.count");
+    builder.CreateStore(builder.CreateAdd(value, builder.getInt64(1)), ptr);
+}
+
+llvm::GlobalVariable* CounterArray::finish(llvm::Module& module, unsigned size)
+{
+    llvm::GlobalVariable* array = create(module, size);
+    if (m_array != nullptr) {
+        array->takeName(m_array);
+        m_array->replaceAllUsesWith(llvm::ConstantExpr::getBitCast(array, m_array->getType()));
+        m_array->eraseFromParent();
+    }
+    m_array = array;
+    return array;
+}
+
+BranchProfile BranchProfile::instrument(uint64_t sourceHash, std::string file)
+{
+    BranchProfile profile(Generate, sourceHash);
+    profile.m_file = std::move(file);
+    return profile;
+}
+
+static llvm::Error ProfileError(llvm::StringRef file, const llvm::Twine& message)
+{
+    return llvm::createStringError(llvm::inconvertibleErrorCode(), file + ": " + message);
+}
+
+llvm::Expected<BranchProfile> BranchProfile::read(llvm::StringRef file, uint64_t sourceHash)
+{
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = llvm::MemoryBuffer::getFile(file);
+    if (std::error_code error = buffer.getError())
+        return ProfileError(file, error.message());
+
+    llvm::SmallVector<llvm::StringRef, 0> lines;
+    (*buffer)->getBuffer().split(lines, '\n', -1, false);
+
+    unsigned version;
+    uint64_t hash, count;
+    if (lines.size() < 3 || !lines[0].consume_front(ProfileMagic) || lines[0].trim().getAsInteger(10, version)
+        || version != ProfileVersion || lines[1].trim().getAsInteger(16, hash) || lines[2].trim().getAsInteger(10, count))
+        return ProfileError(file, "not a Mila profile");
+    if (hash != sourceHash)
+        return ProfileError(file, "profile was collected from a different program");
+    if (lines.size() != 3 + count)
+        return ProfileError(file, "truncated profile");
+
+    BranchProfile profile(Use, sourceHash);
+    profile.m_counts.resize(count);
+    for (uint64_t i = 0; i < count; i++)
+        if (lines[3 + i].trim().getAsInteger(10, profile.m_counts[i]))
+            return ProfileError(file, "bad counter on line " + llvm::Twine(4 + i));
+    return profile;
+}
+
+void BranchProfile::enterFunction(llvm::IRBuilder<>& builder, llvm::Function& function)
+{
+    if (m_mode == Generate)
+        m_counters.increment(builder, 0);
+    else if (!m_counts.empty())
+        function.setEntryCount(llvm::Function::ProfileCount(m_counts[0], llvm::Function::PCT_Real));
+}
+
+unsigned BranchProfile::allocateBranch()
+{
+    unsigned counter = m_allocated;
+    m_allocated += 2;
+    return counter;
+}
+
+llvm::BasicBlock* BranchProfile::falseTarget(llvm::IRBuilder<>& builder, unsigned counter, llvm::BasicBlock* BBfalse)
+{
+    if (m_mode == Use)
+        return BBfalse;
+
+    llvm::IRBuilderBase::InsertPointGuard guard(builder);
+    llvm::BasicBlock* BBcount = llvm::BasicBlock::Create(builder.getContext(), "prof.false", builder.GetInsertBlock()->getParent());
+    builder.SetInsertPoint(BBcount);
+    m_counters.increment(builder, counter + 1);
+    builder.CreateBr(BBfalse);
+    return BBcount;
+}
+
+void BranchProfile::finishBranch(llvm::IRBuilder<>& builder, unsigned counter, llvm::BasicBlock* BBtrue, llvm::BasicBlock* BBfalse)
+{
+    if (m_mode == Generate) {
+        llvm::IRBuilderBase::InsertPointGuard guard(builder);
+        builder.SetInsertPoint(BBtrue);
+        m_counters.increment(builder, counter);
+        return;
+    }
+
+    if (counter + 1 >= m_counts.size())
+        return;
+
+    // Branch weights are 32-bit, long running programs are scaled down
+    uint64_t taken = m_counts[counter], notTaken = m_counts[counter + 1];
+    while (std::max(taken, notTaken) > std::numeric_limits<uint32_t>::max()) {
+        taken >>= 1;
+        notTaken >>= 1;
+    }
+
+    // Only the branches that decide between the two edges are weighted, not the inner ones of a short-circuit
+    llvm::MDBuilder mdBuilder(builder.getContext());
+    for (llvm::BasicBlock* pred : llvm::predecessors(BBtrue)) {
+        auto* branch = llvm::dyn_cast<llvm::BranchInst>(pred->getTerminator());
+        if (branch == nullptr || !branch->isConditional())
+            continue;
+        if (branch->getSuccessor(0) == BBtrue && branch->getSuccessor(1) == BBfalse)
+            branch->setMetadata(llvm::LLVMContext::MD_prof, mdBuilder.createBranchWeights(taken, notTaken));
+        else if (branch->getSuccessor(0) == BBfalse && branch->getSuccessor(1) == BBtrue)
+            branch->setMetadata(llvm::LLVMContext::MD_prof, mdBuilder.createBranchWeights(notTaken, taken));
+    }
+}
+
+llvm::Error BranchProfile::finish(llvm::Module& module)
+{
+    llvm::LLVMContext& ctx = module.getContext();
+
+    if (m_mode == Use) {
+        if (m_counts.size() != m_allocated)
+            return llvm::createStringError(llvm::inconvertibleErrorCode(), "profile has %zu counters, the program needs %u",
+                                           m_counts.size(), m_allocated);
+
+        // The summary tells the optimizer which counts are hot
+        llvm::InstrProfSummaryBuilder summary(llvm::ProfileSummaryBuilder::DefaultCutoffs);
+        summary.addRecord(llvm::InstrProfRecord(m_counts));
+        module.setProfileSummary(summary.getSummary()->getMD(ctx), llvm::ProfileSummary::PSK_Instr);
+        return llvm::Error::success();
+    }
+
+    llvm::GlobalVariable* array = m_counters.finish(module, m_allocated);
+
+    // main hands the counters to the runtime before anything else runs
+    llvm::Function* main = module.getFunction("main");
+    if (main == nullptr || main->isDeclaration())
+        return llvm::Error::success();
+
+    llvm::IRBuilder<> builder(&*main->getEntryBlock().getFirstInsertionPt());
+    llvm::FunctionCallee init = module.getOrInsertFunction(
+            "__mila_profile_init", builder.getVoidTy(), builder.getInt64Ty()->getPointerTo(), builder.getInt32Ty(),
+            builder.getInt64Ty(), builder.getInt8PtrTy());
+    builder.CreateCall(init, {builder.CreateConstGEP2_64(array->getValueType(), array, 0, 0), builder.getInt32(m_allocated),
+                              builder.getInt64(m_sourceHash), builder.CreateGlobalStringPtr(m_file, "prof.file")});
+    return llvm::Error::success();
+}
+
+void LineProfile::count(llvm::IRBuilder<>& builder, SourceLocation loc, Kind kind)
+{
+    m_counters.increment(builder, m_sites.size());
+    m_sites.push_back({loc, kind});
+}
+
+void LineProfile::finish(llvm::Module& module, llvm::StringRef sourceName)
+{
+    llvm::LLVMContext& ctx = module.getContext();
+    llvm::GlobalVariable* array = m_counters.finish(module, m_sites.size());
+
+    // line, column and kind of every counter
+    std::vector<uint32_t> sites;
+    for (const Site& site : m_sites) {
+        sites.push_back(site.loc.line);
+        sites.push_back(site.loc.column);
+        sites.push_back(site.kind == Statement ? 'S' : 'I');
+    }
+    llvm::Constant* table = llvm::ConstantDataArray::get(ctx, sites);
+    auto* sitesGlobal = new llvm::GlobalVariable(module, table->getType(), true, llvm::GlobalValue::PrivateLinkage, table,
+                                                 "__mila_line_sites");
+
+    llvm::Function* main = module.getFunction("main");
+    if (main == nullptr || main->isDeclaration())
+        return;
+
+    // The address of a thread-local array is taken by the thread running main
+    llvm::IRBuilder<> builder(&*main->getEntryBlock().getFirstInsertionPt());
+    llvm::FunctionCallee init = module.getOrInsertFunction(
+            "__mila_lines_init", builder.getVoidTy(), builder.getInt64Ty()->getPointerTo(), builder.getInt32Ty(),
+            builder.getInt32Ty()->getPointerTo(), builder.getInt8PtrTy(), builder.getInt8PtrTy());
+    builder.CreateCall(init, {builder.CreateConstGEP2_64(array->getValueType(), array, 0, 0),
+                              builder.getInt32(m_sites.size()),
+                              builder.CreateConstGEP2_64(sitesGlobal->getValueType(), sitesGlobal, 0, 0),
+                              builder.CreateGlobalStringPtr(sourceName, "lines.source"),
+                              builder.CreateGlobalStringPtr(m_file, "lines.file")});
+}
+
+llvm::Error LineProfile::printReport(llvm::StringRef source, llvm::StringRef countsFile, llvm::raw_ostream& os)
+{
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = llvm::MemoryBuffer::getFile(countsFile);
+    if (std::error_code error = buffer.getError())
+        return ProfileError(countsFile, error.message());
+
+    llvm::SmallVector<llvm::StringRef, 0> lines;
+    (*buffer)->getBuffer().split(lines, '\n', -1, false);
+    if (lines.size() < 3 || lines[0].trim() != "mila-lines 1")
+        return ProfileError(countsFile, "not a Mila line profile");
+
+    // Per source line: how often its first statement ran and how many loop iterations start there
+    struct LineCounts {
+        bool hasStatement = false;
+        uint64_t executions = 0;
+        bool hasLoop = false;
+        uint64_t iterations = 0;
+    };
+    llvm::SmallVector<llvm::StringRef, 0> sourceLines;
+    source.split(sourceLines, '\n');
+    std::vector<LineCounts> counts(sourceLines.size() + 1);
+
+    for (size_t i = 3; i < lines.size(); i++) {
+        llvm::SmallVector<llvm::StringRef, 4> fields;
+        lines[i].split(fields, ' ', -1, false);
+        unsigned line, column;
+        uint64_t count;
+        // Lines of a counts file that does not belong to this source are rejected, not indexed
+        if (fields.size() != 4 || fields[0].getAsInteger(10, line) || fields[1].getAsInteger(10, column)
+            || fields[3].trim().getAsInteger(10, count) || line == 0 || line > sourceLines.size())
+            return ProfileError(countsFile, "bad counter on line " + llvm::Twine(i + 1));
+
+        LineCounts& lineCounts = counts[line];
+        if (fields[2] == "I") {
+            lineCounts.hasLoop = true;
+            lineCounts.iterations += count;
+        } else if (!lineCounts.hasStatement || count > lineCounts.executions) {
+            lineCounts.hasStatement = true;
+            lineCounts.executions = count;
+        }
+    }
+
+    os << "       Count  Line  Source (" << lines[1].trim() << ")\n";
+    std::vector<std::pair<uint64_t, unsigned>> hottest;     // statement count, line
+    for (unsigned line = 1; line <= sourceLines.size(); line++) {
+        const LineCounts& lineCounts = counts[line];
+        if (lineCounts.hasStatement) {
+            os << llvm::format("%12llu", static_cast<unsigned long long>(lineCounts.executions));
+            hottest.emplace_back(lineCounts.executions, line);
+        } else {
+            os.indent(12);
+        }
+        os << llvm::format("  %4u  ", line) << sourceLines[line - 1].rtrim();
+        if (lineCounts.hasLoop)
+            os << "    [" << lineCounts.iterations << " iterations]";
+        os << "\n";
+    }
+
+    std::sort(hottest.begin(), hottest.end(), std::greater<>());
+    os << "\nHottest lines:\n";
+    for (size_t i = 0; i < hottest.size() && i < 5; i++)
+        os << llvm::format("%12llu  %4u  ", static_cast<unsigned long long>(hottest[i].first), hottest[i].second)
+           << sourceLines[hottest[i].second - 1].trim() << "\n";
+    return llvm::Error::success();
+}
@@ -0,0 +1,135 @@
+#ifndef PJPPROJECT_PROFILE_HPP
+#define PJPPROJECT_PROFILE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "Lexer.h"
+
+/*
+ * 64-bit counters of an instrumented program. The number of counters is only known once codegen is
+ * done, until then they are addressed through an empty placeholder array that finish() replaces.
+ */
+class CounterArray {
+public:
+    CounterArray(std::string name, bool threadLocal)
+            : m_name(std::move(name)), m_threadLocal(threadLocal) {}
+
+    void increment(llvm::IRBuilder<>& builder, unsigned index);
+    llvm::GlobalVariable* finish(llvm::Module& module, unsigned size);
+
+private:
+    llvm::GlobalVariable* create(llvm::Module& module, unsigned size);
+
+    std::string m_name;
+    bool m_threadLocal;
+    llvm::GlobalVariable* m_array = nullptr;
+};
+
+/*
+ * Branch profile of a Mila program, used by --profile-generate and --profile-use.
+ *
+ * Counter 0 counts the runs of the program, then every if, while and for gets a pair of counters:
+ * how many times its condition went to the body and how many times it did not. Counters are numbered
+ * in codegen order, so a profile only fits the source it was collected from; the source hash checks that.
+ *
+ * The instrumented program registers its counters with the runtime (__mila_profile_init in fce.c),
+ * which adds them to the profile file at exit. The file is text:
+ *
+ *   mila-profile 1
+ *   <source hash>
+ *   <number of counters>
+ *   <counter 0>
+ *   ...
+ */
+class BranchProfile {
+public:
+    enum Mode {
+        Generate,
+        Use
+    };
+
+    // Instruments the program, the counters are added to `file` when it exits
+    static BranchProfile instrument(uint64_t sourceHash, std::string file);
+    // Reads the counters collected by an instrumented build of the same source
+    static llvm::Expected<BranchProfile> read(llvm::StringRef file, uint64_t sourceHash);
+
+    Mode getMode() const { return m_mode; }
+
+    // Counts or weighs the entry of main, called once the entry block is the insert point
+    void enterFunction(llvm::IRBuilder<>& builder, llvm::Function& function);
+
+    // Reserves the counters of the next condition, returns the first one
+    unsigned allocateBranch();
+    // When instrumenting, returns a block that counts the false edge and jumps on to BBfalse
+    llvm::BasicBlock* falseTarget(llvm::IRBuilder<>& builder, unsigned counter, llvm::BasicBlock* BBfalse);
+    // Counts the true edge at the start of BBtrue, or puts the collected weights on the branches of the condition
+    void finishBranch(llvm::IRBuilder<>& builder, unsigned counter, llvm::BasicBlock* BBtrue, llvm::BasicBlock* BBfalse);
+
+    // Sizes the counter array and checks that a used profile had the same number of counters
+    llvm::Error finish(llvm::Module& module);
+
+private:
+    BranchProfile(Mode mode, uint64_t sourceHash)
+            : m_mode(mode), m_sourceHash(sourceHash) {}
+
+    Mode m_mode;
+    uint64_t m_sourceHash;
+    std::string m_file;                     // where the instrumented program writes its counters
+    std::vector<uint64_t> m_counts;         // counters read from the profile
+    unsigned m_allocated = 1;               // counter 0 counts entries of main
+    CounterArray m_counters {"__mila_profile_counters", false};
+};
+
+/*
+ * Source-level execution profile, used by --line-profile and --line-report.
+ *
+ * Every executed statement has a counter, every loop one more for its iterations. The counters live in
+ * a thread-local array, so an increment is a plain load, add and store. At exit the runtime
+ * (__mila_lines_init in fce.c) writes them with their source positions:
+ *
+ *   mila-lines 1
+ *   <source file>
+ *   <number of counters>
+ *   <line> <column> <S for a statement, I for loop iterations> <count>
+ *   ...
+ *
+ * printReport turns that file into the source annotated with the counts.
+ */
+class LineProfile {
+public:
+    enum Kind {
+        Statement,
+        Iteration
+    };
+
+    explicit LineProfile(std::string file)
+            : m_file(std::move(file)) {}
+
+    // Counts one execution of whatever is emitted next
+    void count(llvm::IRBuilder<>& builder, SourceLocation loc, Kind kind);
+    // Emits the counter array, the location table and their registration at the start of main
+    void finish(llvm::Module& module, llvm::StringRef sourceName);
+
+    static llvm::Error printReport(llvm::StringRef source, llvm::StringRef countsFile, llvm::raw_ostream& os);
+
+private:
+    struct Site {
+        SourceLocation loc;
+        Kind kind;
+    };
+
+    std::string m_file;                     // where the instrumented program writes the counts
+    std::vector<Site> m_sites;
+    CounterArray m_counters {"__mila_line_counters", true};
+};
+
+#endif //PJPPROJECT_PROFILE_HPP
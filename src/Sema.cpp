@@ -0,0 +1,289 @@
+#include "Sema.h"
+
+#include <cstdint>
+
+#include <llvm/Support/Casting.h>
+#include <llvm/Support/ErrorHandling.h>
+
+void Sema::analyze(ProgramASTNode& program)
+{
+    analyzeBody(program.m_statements);
+}
+
+void Sema::analyzeBody(std::vector<std::unique_ptr<StatementASTNode>>& body)
+{
+    for (auto& statement : body)
+        analyzeStatement(*statement);
+}
+
+void Sema::analyzeStatement(StatementASTNode& statement)
+{
+    m_Loc = statement.getLocation();
+
+    switch (statement.getKind()) {
+        case ASTKind::If: {
+            auto& ifNode = llvm::cast<IfASTNode>(statement);
+            analyzeExpr(*ifNode.m_cond);
+            analyzeBody(ifNode.m_bodyTrue);
+            analyzeBody(ifNode.m_bodyFalse);
+            break;
+        }
+        case ASTKind::While: {
+            auto& whileNode = llvm::cast<WhileASTNode>(statement);
+            analyzeExpr(*whileNode.m_cond);
+            m_LoopDepth++;
+            analyzeBody(whileNode.m_body);
+            m_LoopDepth--;
+            break;
+        }
+        case ASTKind::For: {
+            auto& forNode = llvm::cast<ForASTNode>(statement);
+            bool valid = analyzeAssign(*forNode.m_initialization);
+            // The condition and the increment name the variable again, not the element of an array
+            if (valid && !llvm::isa<DeclRefASTNode>(*forNode.m_initialization->m_var)) {
+                error("the variable of a 'for' cannot be an array element");
+                valid = false;
+            }
+            // Errors of the variable are reported once, at the initialization
+            if (valid)
+                analyzeExpr(*forNode.m_condition);
+            m_LoopDepth++;
+            analyzeBody(forNode.m_body);
+            m_LoopDepth--;
+            m_Loc = statement.getLocation();
+            if (valid)
+                analyzeAssign(*forNode.m_increment);
+            break;
+        }
+        case ASTKind::Break:
+            if (m_LoopDepth == 0)
+                error("'break' outside of a loop");
+            break;
+        case ASTKind::Continue:
+            if (m_LoopDepth == 0)
+                error("'continue' outside of a loop");
+            break;
+        case ASTKind::FunCall:
+            analyzeFunCall(llvm::cast<FunCallASTNode>(statement));
+            break;
+        case ASTKind::ConstDecl: {
+            auto& constDecl = llvm::cast<ConstDeclASTNode>(statement);
+            Type type = analyzeExpr(*constDecl.m_expr);
+            if (!llvm::isa<LiteralASTNode, FloatLiteralASTNode>(*constDecl.m_expr))
+                error("the value of a constant must be a number");
+            Symbol symbol {constDecl.m_const, type};
+            symbol.constant = true;
+            declare(constDecl.m_const, constDecl.getLocation(), symbol, constDecl.m_symbol);
+            break;
+        }
+        case ASTKind::VarDecl: {
+            auto& varDecl = llvm::cast<VarDeclASTNode>(statement);
+            if (varDecl.m_type->getType() != Type::INT)
+                error("variables can only be integers");
+            declare(varDecl.m_var, varDecl.getLocation(), {varDecl.m_var, Type::INT}, varDecl.m_symbol);
+            break;
+        }
+        case ASTKind::ArrayDecl: {
+            auto& arrayDecl = llvm::cast<ArrayDeclASTNode>(statement);
+            if (arrayDecl.m_type->getType() != Type::INT)
+                error("variables can only be integers");
+            Symbol symbol {arrayDecl.m_var, Type::INT};
+            symbol.numberOfElements = 1;
+            symbol.offset = arrayDecl.m_lowerBound;
+            int64_t elements = static_cast<int64_t>(arrayDecl.m_upperBound) - arrayDecl.m_lowerBound + 1;
+            if (elements < 1)
+                error("the upper bound of '" + arrayDecl.m_var + "' is below its lower bound");
+            else if (elements > INT32_MAX)
+                error("'" + arrayDecl.m_var + "' has too many elements");
+            else
+                symbol.numberOfElements = elements;
+            declare(arrayDecl.m_var, arrayDecl.getLocation(), symbol, arrayDecl.m_symbol);
+            break;
+        }
+        case ASTKind::Assign:
+            analyzeAssign(llvm::cast<AssignASTNode>(statement));
+            break;
+        default:
+            llvm_unreachable("not a statement");
+    }
+}
+
+// False when the variable is not one that can be assigned, that error is reported
+bool Sema::analyzeAssign(AssignASTNode& assign)
+{
+    bool valid = analyzeTarget(*assign.m_var);
+
+    // Variables are integers, a real is not silently truncated into one
+    if (analyzeExpr(*assign.m_expr) == Type::DOUBLE)
+        error("a real cannot be assigned to an integer variable");
+    return valid;
+}
+
+// A variable that is assigned or read into
+bool Sema::analyzeTarget(VarASTNode& var)
+{
+    analyzeExpr(var);
+    if (var.m_symbol == NoSymbol)
+        return false;
+    if (m_Symbols[var.m_symbol].constant) {
+        error(var, "'" + var.m_var + "' is a constant");
+        return false;
+    }
+    return true;
+}
+
+void Sema::analyzeFunCall(FunCallASTNode& call)
+{
+    // The runtime reads into one variable and writes one value, an AST file may hold other calls
+    bool read = call.m_func == "readln";
+    if (call.m_Refs.size() != (read ? 1 : 0) || call.m_Exprs.size() != (read ? 0 : 1))
+        error("'" + call.m_func + "' takes one " + (read ? "variable" : "value"));
+
+    for (auto& ref : call.m_Refs)
+        analyzeTarget(*ref);
+    for (auto& expr : call.m_Exprs)
+        analyzeExpr(*expr);
+}
+
+Type Sema::analyzeExpr(ExprASTNode& expr)
+{
+    Type type = Type::INT;
+    switch (expr.getKind()) {
+        case ASTKind::BinOp:
+            type = analyzeBinOp(llvm::cast<BinOpASTNode>(expr));
+            break;
+        case ASTKind::UnaryOp: {
+            auto& unaryOp = llvm::cast<UnaryOpASTNode>(expr);
+            // 'not' is logical on truth values, bitwise on integers
+            type = analyzeExpr(*unaryOp.getExpr());
+            if (type == Type::DOUBLE)
+                error(llvm::Twine("operator ") + getTokenSpelling(unaryOp.getOp()) + " is not defined for reals");
+            break;
+        }
+        case ASTKind::Literal: {
+            // The lexer takes any number of 64 bits, integers have 32
+            int64_t value = llvm::cast<LiteralASTNode>(expr).getValue();
+            if (value < INT32_MIN || value > INT32_MAX)
+                error(expr, llvm::Twine(value) + " does not fit in an integer");
+            break;
+        }
+        case ASTKind::FloatLiteral:
+            type = Type::DOUBLE;
+            break;
+        case ASTKind::DeclRef: {
+            auto& ref = llvm::cast<DeclRefASTNode>(expr);
+            ref.m_symbol = resolve(ref, false);
+            if (ref.m_symbol != NoSymbol)
+                type = m_Symbols[ref.m_symbol].type;
+            break;
+        }
+        case ASTKind::DeclArrayRef: {
+            auto& ref = llvm::cast<DeclArrayRefASTNode>(expr);
+            ref.m_symbol = resolve(ref, true);
+            if (ref.m_symbol != NoSymbol)
+                type = m_Symbols[ref.m_symbol].type;
+            if (analyzeExpr(*ref.m_index) == Type::DOUBLE)
+                error("an array index must be an integer");
+            break;
+        }
+        default:
+            llvm_unreachable("not an expression");
+    }
+    expr.setType(type);
+    return type;
+}
+
+Type Sema::analyzeBinOp(BinOpASTNode& binOp)
+{
+    Type lhs = analyzeExpr(*binOp.m_lhs);
+    Type rhs = analyzeExpr(*binOp.m_rhs);
+    bool real = lhs == Type::DOUBLE || rhs == Type::DOUBLE;
+    bool truth = lhs == Type::BOOL && rhs == Type::BOOL;
+
+    switch (binOp.m_op) {
+        case Token::tok_sum:
+        case Token::tok_substract:
+        case Token::tok_multiply:
+        case Token::tok_div:
+            binOp.m_operandType = real ? Type::DOUBLE : Type::INT;
+            return binOp.m_operandType;
+        case Token::tok_equal:
+            binOp.m_operandType = real ? Type::DOUBLE : truth ? Type::BOOL : Type::INT;
+            return Type::BOOL;
+        default:
+            break;
+    }
+
+    // Reals have no other operators; the result is still taken to be a real, using it is checked as one
+    if (real) {
+        error(llvm::Twine("operator ") + getTokenSpelling(binOp.m_op) + " is not defined for reals");
+        binOp.m_operandType = Type::DOUBLE;
+        return Type::DOUBLE;
+    }
+
+    switch (binOp.m_op) {
+        case Token::tok_mod:
+            binOp.m_operandType = Type::INT;
+            return Type::INT;
+        case Token::tok_greater:
+        case Token::tok_less:
+        case Token::tok_greaterequal:
+        case Token::tok_lessequal:
+            binOp.m_operandType = Type::INT;
+            return Type::BOOL;
+        case Token::tok_notequal:
+            binOp.m_operandType = truth ? Type::BOOL : Type::INT;
+            return Type::BOOL;
+        case Token::tok_xor:
+        case Token::tok_and:
+        case Token::tok_or:
+            // Logic on truth values, bitwise on integers; a truth value and an integer are both integers
+            binOp.m_operandType = truth ? Type::BOOL : Type::INT;
+            return binOp.m_operandType;
+        default:
+            llvm_unreachable("the parser only builds the operators above");
+    }
+}
+
+// The symbol of a name used as an array or as a variable, NoSymbol after an error
+unsigned Sema::resolve(const VarASTNode& ref, bool array)
+{
+    auto [it, inserted] = m_Scope.try_emplace(ref.m_var, NoSymbol);
+    if (inserted) {
+        // Only the first use of an undeclared name is reported
+        error(ref, "'" + ref.m_var + (array ? "' is not a declared array" : "' is not declared"));
+        return NoSymbol;
+    }
+    if (it->second == NoSymbol)
+        return NoSymbol;
+
+    bool isArray = m_Symbols[it->second].numberOfElements != 0;
+    if (array && !isArray) {
+        error(ref, "'" + ref.m_var + "' is not a declared array");
+        return NoSymbol;
+    }
+    if (!array && isArray) {
+        error(ref, "'" + ref.m_var + "' is an array, it needs an index");
+        return NoSymbol;
+    }
+    return it->second;
+}
+
+void Sema::declare(const std::string& name, SourceLocation loc, Symbol symbol, unsigned& index)
+{
+    auto [it, inserted] = m_Scope.try_emplace(name, NoSymbol);
+    if (!inserted && it->second != NoSymbol)
+        m_Diags.error(loc, "redefinition of '" + name + "'");
+
+    // Later references see the latest declaration
+    index = m_Symbols.size();
+    m_Symbols.push_back(std::move(symbol));
+    it->second = index;
+}
+
+// Nodes the parser built without a location, like the references of a 'for', report at their statement
+void Sema::error(const ASTNode& node, const llvm::Twine& message)
+{
+    SourceLocation loc = node.getLocation();
+    m_Diags.error(loc.line != 0 ? loc : m_Loc, message);
+}
@@ -0,0 +1,57 @@
+#ifndef PJPPROJECT_SEMA_HPP
+#define PJPPROJECT_SEMA_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/Twine.h>
+
+#include "Diagnostics.h"
+#include "ast.h"
+
+/*
+ * Semantic analysis, between the parser and codegen. Resolves every name to the symbol of its declaration,
+ * computes the type of every expression once and reports what the language does not allow, so codegen
+ * is one walk over an annotated tree that is known to be valid:
+ *
+ *   ConstDecl, VarDecl, ArrayDecl   m_symbol: a new entry of GenContext::symbols
+ *   DeclRef, DeclArrayRef           m_symbol: the entry of the declaration of their name
+ *   every expression                getType(): INT, DOUBLE, or BOOL for truth values
+ *   BinOp                           m_operandType: the type both operands are computed in
+ *
+ * Declarations stay visible after the statement that made them, so a program may be analyzed one
+ * top-level statement at a time, as the parser finishes them.
+ */
+class Sema {
+public:
+    Sema(std::vector<Symbol>& symbols, Diagnostics& diags)
+            : m_Symbols(symbols)
+            , m_Diags(diags) {}
+
+    void analyze(ProgramASTNode& program);
+    // Errors are reported at the statement, errors about a name or a number at it
+    void analyzeStatement(StatementASTNode& statement);
+
+private:
+    void analyzeBody(std::vector<std::unique_ptr<StatementASTNode>>& body);
+    bool analyzeAssign(AssignASTNode& assign);
+    bool analyzeTarget(VarASTNode& var);
+    void analyzeFunCall(FunCallASTNode& call);
+    Type analyzeExpr(ExprASTNode& expr);
+    Type analyzeBinOp(BinOpASTNode& binOp);
+    unsigned resolve(const VarASTNode& ref, bool array);
+    void declare(const std::string& name, SourceLocation loc, Symbol symbol, unsigned& index);
+
+    void error(const llvm::Twine& message) { m_Diags.error(m_Loc, message); }
+    void error(const ASTNode& node, const llvm::Twine& message);
+
+    std::vector<Symbol>& m_Symbols;
+    Diagnostics& m_Diags;
+    llvm::StringMap<unsigned> m_Scope;  // every name seen, to its latest symbol; NoSymbol once reported undeclared
+    SourceLocation m_Loc;               // of the statement being analyzed
+    unsigned m_LoopDepth = 0;
+};
+
+#endif //PJPPROJECT_SEMA_HPP
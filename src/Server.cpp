@@ -0,0 +1,307 @@
+#include "Server.h"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <string>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/raw_ostream.h>
+
+static const char RequestMagic[] = "mila-compile 1\n";
+static const char ResultMagic[] = "mila-result 1\n";
+
+// A client sends its whole request at once; one that has not finished by then holds no worker any longer
+static constexpr std::chrono::seconds RequestTimeout(10);
+
+static bool WriteAll(int fd, llvm::StringRef data)
+{
+    while (!data.empty()) {
+        ssize_t written = ::write(fd, data.data(), data.size());
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data = data.drop_front(written);
+    }
+    return true;
+}
+
+// Reads until the peer shuts its side of the connection down. With a timeout, a peer that has not done so in
+// time is given up on
+static bool ReadAll(int fd, std::string& data, std::chrono::milliseconds timeout = std::chrono::milliseconds::max())
+{
+    bool limited = timeout != std::chrono::milliseconds::max();
+    auto deadline = limited ? std::chrono::steady_clock::now() + timeout : std::chrono::steady_clock::time_point();
+    char buffer[65536];
+    while (true) {
+        if (limited) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            pollfd ready {fd, POLLIN, 0};
+            int count = left.count() > 0 ? ::poll(&ready, 1, static_cast<int>(left.count())) : 0;
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+        }
+        ssize_t size = ::read(fd, buffer, sizeof(buffer));
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size < 0)
+            return false;
+        if (size == 0)
+            return true;
+        data.append(buffer, size);
+    }
+}
+
+static void WriteField(llvm::raw_ostream& os, llvm::StringRef name, llvm::StringRef value)
+{
+    os << name << " " << value.size() << "\n" << value;
+}
+
+// Splits a message into its fields, returns false when it is not a complete message of this kind
+static bool ReadFields(llvm::StringRef message, llvm::StringRef magic, llvm::StringMap<std::string>& fields)
+{
+    if (!message.consume_front(magic))
+        return false;
+
+    while (!message.empty()) {
+        auto [header, rest] = message.split('\n');
+        auto [name, sizeText] = header.split(' ');
+        size_t size;
+        if (sizeText.getAsInteger(10, size) || size > rest.size())
+            return false;
+        fields[name] = rest.take_front(size).str();
+        message = rest.drop_front(size);
+    }
+    return true;
+}
+
+static std::string GetField(const llvm::StringMap<std::string>& fields, llvm::StringRef name)
+{
+    auto it = fields.find(name);
+    return it == fields.end() ? std::string() : it->second;
+}
+
+static void WriteRequest(llvm::raw_ostream& os, const CompileOptions& options, const std::string* input)
+{
+    os << RequestMagic;
+    WriteField(os, "input-file", options.inputFile);
+    WriteField(os, "output-file", options.outputFile);
+    WriteField(os, "emit", std::to_string(static_cast<int>(options.emit)));
+    WriteField(os, "opt-level", std::to_string(options.optLevel));
+    WriteField(os, "debug-info", options.debugInfo ? "1" : "0");
+    WriteField(os, "pipeline", options.pipeline ? "1" : "0");
+    WriteField(os, "profile-generate", options.profileGenerate);
+    WriteField(os, "profile-use", options.profileUse);
+    WriteField(os, "line-profile", options.lineProfile);
+    WriteField(os, "line-report", options.lineReport);
+    WriteField(os, "cache-dir", options.cacheDir);
+    if (input != nullptr)
+        WriteField(os, "input", *input);
+}
+
+static bool ReadRequest(llvm::StringRef message, CompileOptions& options, std::string& input, bool& hasInput)
+{
+    llvm::StringMap<std::string> fields;
+    if (!ReadFields(message, RequestMagic, fields))
+        return false;
+
+    options.inputFile = GetField(fields, "input-file");
+    options.outputFile = GetField(fields, "output-file");
+    int emit;
+    if (llvm::StringRef(GetField(fields, "emit")).getAsInteger(10, emit) || emit < 0 || emit > static_cast<int>(EmitKind::AST))
+        return false;
+    options.emit = static_cast<EmitKind>(emit);
+    if (llvm::StringRef(GetField(fields, "opt-level")).getAsInteger(10, options.optLevel))
+        return false;
+    options.debugInfo = GetField(fields, "debug-info") == "1";
+    options.pipeline = GetField(fields, "pipeline") == "1";
+    options.profileGenerate = GetField(fields, "profile-generate");
+    options.profileUse = GetField(fields, "profile-use");
+    options.lineProfile = GetField(fields, "line-profile");
+    options.lineReport = GetField(fields, "line-report");
+    options.cacheDir = GetField(fields, "cache-dir");
+    hasInput = fields.count("input") != 0;
+    input = GetField(fields, "input");
+    return true;
+}
+
+static void Serve(int client)
+{
+    std::string request;
+    if (!ReadAll(client, request, RequestTimeout))
+        return;
+
+    CompileOptions options;
+    std::string input;
+    bool hasInput;
+    std::string out, err;
+    int status = 1;
+    {
+        llvm::raw_string_ostream outStream(out), errStream(err);
+        if (ReadRequest(request, options, input, hasInput))
+            status = Compile(options, {outStream, errStream, hasInput ? &input : nullptr});
+        else
+            errStream << "Malformed compile request\n";
+    }
+
+    std::string result;
+    llvm::raw_string_ostream os(result);
+    os << ResultMagic;
+    WriteField(os, "status", std::to_string(status));
+    WriteField(os, "out", out);
+    WriteField(os, "err", err);
+    os.flush();
+    WriteAll(client, result);
+}
+
+// The socket file is removed when the server is stopped, so the next one can bind the same path
+static char ServerSocketPath[sizeof(sockaddr_un::sun_path)];
+
+static void StopServer(int)
+{
+    ::unlink(ServerSocketPath);
+    _exit(0);
+}
+
+int RunServer(llvm::StringRef socketPath, unsigned threads)
+{
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+        llvm::errs() << "Invalid socket path " << socketPath << "\n";
+        return 1;
+    }
+    memcpy(address.sun_path, socketPath.data(), socketPath.size());
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        llvm::errs() << "Error creating socket: " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    // A socket left behind by a server that was killed is taken over, any other file is not touched
+    struct stat status;
+    if (::stat(address.sun_path, &status) == 0 && S_ISSOCK(status.st_mode))
+        ::unlink(address.sun_path);
+
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(listener, SOMAXCONN) < 0) {
+        llvm::errs() << "Error listening on " << socketPath << ": " << strerror(errno) << "\n";
+        ::close(listener);
+        return 1;
+    }
+
+    memcpy(ServerSocketPath, address.sun_path, sizeof(ServerSocketPath));
+    std::signal(SIGINT, StopServer);
+    std::signal(SIGTERM, StopServer);
+    std::signal(SIGPIPE, SIG_IGN);       // a client that went away is an error on its socket, not a signal
+
+    llvm::ThreadPool pool(llvm::hardware_concurrency(threads));
+    llvm::errs() << "Serving compilations on " << socketPath << " with " << pool.getThreadCount() << " threads\n";
+
+    while (true) {
+        int client = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            llvm::errs() << "Error accepting a connection: " << strerror(errno) << "\n";
+            break;
+        }
+        pool.async([client] {
+            Serve(client);
+            ::close(client);
+        });
+    }
+
+    pool.wait();
+    ::close(listener);
+    ::unlink(ServerSocketPath);
+    return 1;
+}
+
+// The server does not share the client's working directory, files the compiler opens are made absolute.
+// Paths compiled into the program (--profile-generate, --line-profile) stay relative to where it runs
+static std::string ClientPath(const std::string& path)
+{
+    if (path.empty() || path == "-")
+        return path;
+    llvm::SmallString<128> absolute(path);
+    llvm::sys::fs::make_absolute(absolute);
+    return std::string(absolute);
+}
+
+int CompileRemote(llvm::StringRef socketPath, const CompileOptions& options)
+{
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+        return -1;
+    memcpy(address.sun_path, socketPath.data(), socketPath.size());
+
+    int server = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server < 0)
+        return -1;
+    if (::connect(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        ::close(server);
+        return -1;
+    }
+
+    CompileOptions remote = options;
+    remote.inputFile = ClientPath(options.inputFile);
+    remote.outputFile = ClientPath(options.outputFile);
+    remote.profileUse = ClientPath(options.profileUse);
+    remote.lineReport = ClientPath(options.lineReport);
+    remote.cacheDir = ClientPath(options.cacheDir);
+
+    // Standard input is the client's, it travels with the request
+    std::string input;
+    if (options.inputFile == "-") {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = llvm::MemoryBuffer::getSTDIN();
+        if (!buffer) {
+            llvm::errs() << "Error reading standard input: " << buffer.getError().message() << "\n";
+            ::close(server);
+            return 1;
+        }
+        input = (*buffer)->getBuffer().str();
+    }
+
+    std::string request;
+    llvm::raw_string_ostream os(request);
+    WriteRequest(os, remote, options.inputFile == "-" ? &input : nullptr);
+    os.flush();
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::string response;
+    bool sent = WriteAll(server, request) && ::shutdown(server, SHUT_WR) == 0;
+    bool received = sent && ReadAll(server, response);
+    ::close(server);
+
+    llvm::StringMap<std::string> fields;
+    int status;
+    if (!received || !ReadFields(response, ResultMagic, fields) || llvm::StringRef(GetField(fields, "status")).getAsInteger(10, status)) {
+        // Standard input was consumed, only a request without it can be compiled locally instead
+        if (options.inputFile == "-") {
+            llvm::errs() << "Error: the compile server at " << socketPath << " did not answer\n";
+            return 1;
+        }
+        return -1;
+    }
+
+    llvm::outs() << GetField(fields, "out");
+    llvm::errs() << GetField(fields, "err");
+    return status;
+}
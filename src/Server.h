@@ -0,0 +1,30 @@
+#ifndef PJPPROJECT_SERVER_HPP
+#define PJPPROJECT_SERVER_HPP
+
+#include <llvm/ADT/StringRef.h>
+
+#include "Driver.h"
+
+/*
+ * Compile server: a long-running mila that takes compilations over a Unix socket, so a build that runs
+ * the compiler many times does not pay for process startup and LLVM's initialization every time.
+ *
+ * A client connects, sends one request and shuts its side down, the server answers and closes:
+ *
+ *   mila-compile 1              mila-result 1
+ *   <name> <size>\n<bytes>      status <size>\n<exit code>
+ *   ...                         out <size>\n<standard output>
+ *                               err <size>\n<standard error>
+ *
+ * Requests are compiled concurrently on a thread pool, every compilation has its own LLVMContext.
+ * Time reports and counters would describe the whole server, compilations that ask for them run in the client.
+ */
+
+// Serves compilations on socketPath with `threads` workers (0 uses every core); returns only on failure
+int RunServer(llvm::StringRef socketPath, unsigned threads);
+
+// Has the server at socketPath compile, relays its output and returns its exit code, or -1 when no
+// server could do it and the caller should compile by itself
+int CompileRemote(llvm::StringRef socketPath, const CompileOptions& options);
+
+#endif //PJPPROJECT_SERVER_HPP
@@ -0,0 +1,210 @@
+#include "Stats.h"
+
+#include <ctime>
+#include <sys/resource.h>
+
+#include <llvm/Support/Format.h>
+#include <llvm/Support/JSON.h>
+
+#include "ast_visitor.h"
+
+static double ProcessCPUTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+CompileStats::Timer::Timer(CompileStats* stats, Phase phase)
+        : m_stats(stats)
+        , m_phase(phase)
+{
+    if (m_stats == nullptr)
+        return;
+    m_wallStart = std::chrono::steady_clock::now();
+    m_cpuStart = ProcessCPUTime();
+}
+
+CompileStats::Timer::~Timer()
+{
+    if (m_stats == nullptr)
+        return;
+    PhaseTimes& times = m_stats->m_phases[m_phase];
+    times.wall += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_wallStart).count();
+    times.cpu += ProcessCPUTime() - m_cpuStart;
+    times.peakRSS = peakRSS();
+    times.ran = true;
+}
+
+void CompileStats::finishLexing()
+{
+    PhaseTimes& lex = m_phases[Lex];
+    PhaseTimes& parse = m_phases[Parse];
+
+    // The lexer only runs on the CPU, its CPU time is taken to be its wall time
+    lex.wall = std::chrono::duration<double>(m_lexWall).count();
+    lex.cpu = lex.wall;
+    lex.peakRSS = parse.peakRSS;
+    lex.ran = true;
+
+    parse.wall = std::max(0.0, parse.wall - lex.wall);
+    parse.cpu = std::max(0.0, parse.cpu - lex.cpu);
+}
+
+void CompileStats::finishPipeline()
+{
+    PhaseTimes& lex = m_phases[Lex];
+    PhaseTimes& parse = m_phases[Parse];
+    const PhaseTimes& sema = m_phases[Sema];
+    const PhaseTimes& codegen = m_phases[Codegen];
+
+    lex.wall = std::chrono::duration<double>(m_lexWall).count();
+    lex.cpu = lex.wall;
+    lex.peakRSS = parse.peakRSS;
+    lex.ran = true;
+
+    parse.wall = std::max(0.0, parse.wall - sema.wall - codegen.wall);
+    parse.cpu = std::max(0.0, parse.cpu - sema.cpu - codegen.cpu);
+}
+
+namespace {
+class ASTCounter : public RecursiveASTVisitor<ASTCounter> {
+public:
+    explicit ASTCounter(uint64_t* counts)
+            : m_counts(counts) {}
+    void visitNode(const ASTNode& node) { m_counts[static_cast<size_t>(node.getKind())]++; }
+
+private:
+    uint64_t* m_counts;
+};
+}
+
+void CompileStats::countAST(const ASTNode& node)
+{
+    ASTCounter(m_astNodes.data()).traverse(&node);
+}
+
+void CompileStats::countIR(const llvm::Module& module, bool optimized)
+{
+    IRCounts counts;
+    for (const llvm::Function& function : module) {
+        if (function.isDeclaration())
+            continue;
+        counts.functions++;
+        for (const llvm::BasicBlock& BB : function) {
+            counts.basicBlocks++;
+            counts.instructions += BB.size();
+        }
+    }
+
+    if (optimized) {
+        m_irFinal = counts;
+        m_optimized = true;
+    } else {
+        m_irCodegen = counts;
+        m_irFinal = counts;
+    }
+}
+
+const char* CompileStats::phaseName(Phase phase)
+{
+    switch (phase) {
+        case Lex: return "lex";
+        case Parse: return "parse";
+        case Sema: return "sema";
+        case Codegen: return "codegen";
+        case Verify: return "verify";
+        case Optimize: return "optimize";
+        case Emit: return "emit";
+        default: return "unknown";
+    }
+}
+
+long CompileStats::peakRSS()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void CompileStats::printTimeReport(llvm::raw_ostream& os) const
+{
+    double totalWall = 0, totalCPU = 0;
+    for (const PhaseTimes& times : m_phases) {
+        totalWall += times.wall;
+        totalCPU += times.cpu;
+    }
+
+    os << "===== Mila compile time report =====\n";
+    os << "  phase         wall (ms)     cpu (ms)   wall %  peak RSS (KiB)\n";
+    for (int phase = 0; phase < NumPhases; phase++) {
+        const PhaseTimes& times = m_phases[phase];
+        if (!times.ran)
+            continue;
+        os << llvm::format("  %-10s %12.3f %12.3f %7.1f%% %14ld\n", phaseName(static_cast<Phase>(phase)),
+                           times.wall * 1e3, times.cpu * 1e3, totalWall > 0 ? times.wall / totalWall * 100 : 0.0, times.peakRSS);
+    }
+    os << llvm::format("  %-10s %12.3f %12.3f %7.1f%% %14ld\n", static_cast<const char*>("total"), totalWall * 1e3, totalCPU * 1e3, 100.0, peakRSS());
+}
+
+void CompileStats::printStats(llvm::raw_ostream& os) const
+{
+    auto row = [&os](const char* name, uint64_t value, int indent = 2) {
+        os.indent(indent) << llvm::format("%-*s %12llu\n", 26 - indent, name, static_cast<unsigned long long>(value));
+    };
+
+    os << "===== Mila compile statistics =====\n";
+    row("tokens", m_tokens);
+
+    uint64_t totalNodes = 0;
+    for (uint64_t count : m_astNodes)
+        totalNodes += count;
+    row("AST nodes", totalNodes);
+    for (size_t kind = 0; kind < m_astNodes.size(); kind++)
+        if (m_astNodes[kind] != 0)
+            row(getKindName(static_cast<ASTKind>(kind)), m_astNodes[kind], 4);
+
+    row("IR functions", m_irCodegen.functions);
+    row("IR basic blocks", m_irCodegen.basicBlocks);
+    row("IR instructions", m_irCodegen.instructions);
+    if (m_optimized) {
+        row("optimized basic blocks", m_irFinal.basicBlocks);
+        row("optimized instructions", m_irFinal.instructions);
+    }
+}
+
+void CompileStats::printJSON(llvm::raw_ostream& os) const
+{
+    llvm::json::OStream json(os, 2);
+    json.object([&] {
+        json.attributeObject("phases", [&] {
+            for (int phase = 0; phase < NumPhases; phase++) {
+                const PhaseTimes& times = m_phases[phase];
+                if (!times.ran)
+                    continue;
+                json.attributeObject(phaseName(static_cast<Phase>(phase)), [&] {
+                    json.attribute("wall_ms", times.wall * 1e3);
+                    json.attribute("cpu_ms", times.cpu * 1e3);
+                    json.attribute("peak_rss_kib", static_cast<int64_t>(times.peakRSS));
+                });
+            }
+        });
+        json.attribute("peak_rss_kib", static_cast<int64_t>(peakRSS()));
+        json.attributeObject("counters", [&] {
+            json.attribute("tokens", static_cast<int64_t>(m_tokens));
+            json.attributeObject("ast_nodes", [&] {
+                for (size_t kind = 0; kind < m_astNodes.size(); kind++)
+                    if (m_astNodes[kind] != 0)
+                        json.attribute(getKindName(static_cast<ASTKind>(kind)), static_cast<int64_t>(m_astNodes[kind]));
+            });
+            json.attribute("ir_functions", static_cast<int64_t>(m_irCodegen.functions));
+            json.attribute("ir_basic_blocks", static_cast<int64_t>(m_irCodegen.basicBlocks));
+            json.attribute("ir_instructions", static_cast<int64_t>(m_irCodegen.instructions));
+            if (m_optimized) {
+                json.attribute("optimized_basic_blocks", static_cast<int64_t>(m_irFinal.basicBlocks));
+                json.attribute("optimized_instructions", static_cast<int64_t>(m_irFinal.instructions));
+            }
+        });
+    });
+    os << "\n";
+}
@@ -0,0 +1,98 @@
+#ifndef PJPPROJECT_STATS_HPP
+#define PJPPROJECT_STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "ast.h"
+
+/*
+ * Phase timings, memory high-water marks and counters of one compilation, reported by --time-report and --stats.
+ */
+class CompileStats {
+public:
+    enum Phase {
+        Lex,
+        Parse,
+        Sema,
+        Codegen,
+        Verify,
+        Optimize,
+        Emit,
+        NumPhases
+    };
+
+    struct PhaseTimes {
+        double wall = 0;        // seconds
+        double cpu = 0;         // seconds of process CPU time
+        long peakRSS = 0;       // KiB, high-water mark of the process when the phase ended
+        bool ran = false;
+    };
+
+    // Measures wall and CPU time of a whole phase
+    class Timer {
+    public:
+        Timer(CompileStats* stats, Phase phase);
+        ~Timer();
+
+    private:
+        CompileStats* m_stats;
+        Phase m_phase;
+        std::chrono::steady_clock::time_point m_wallStart;
+        double m_cpuStart;
+    };
+
+    // Lexing is interleaved with parsing, one token at a time: only the cheap wall clock is read around each token
+    void startToken() { m_tokenStart = std::chrono::steady_clock::now(); }
+    void endToken()
+    {
+        m_lexWall += std::chrono::steady_clock::now() - m_tokenStart;
+        m_tokens++;
+    }
+    // Moves the time spent in the lexer out of the parse phase
+    void finishLexing();
+    // Of a lexer that ran on its own thread, ahead of the parser
+    void addLexing(std::chrono::steady_clock::duration wall, uint64_t tokens)
+    {
+        m_lexWall += wall;
+        m_tokens += tokens;
+    }
+    // Moves the time of statements analyzed and generated while parsing out of the parse phase, parsing and codegen
+    // overlapped with a lexer thread: the CPU time of both includes what the lexer used meanwhile
+    void finishPipeline();
+
+    // Adds the nodes of a subtree
+    void countAST(const ASTNode& node);
+    void countIR(const llvm::Module& module, bool optimized);
+
+    void printTimeReport(llvm::raw_ostream& os) const;
+    void printStats(llvm::raw_ostream& os) const;
+    void printJSON(llvm::raw_ostream& os) const;
+
+    static const char* phaseName(Phase phase);
+    static long peakRSS();
+
+private:
+    struct IRCounts {
+        uint64_t functions = 0;
+        uint64_t basicBlocks = 0;
+        uint64_t instructions = 0;
+    };
+
+    std::array<PhaseTimes, NumPhases> m_phases;
+
+    std::chrono::steady_clock::time_point m_tokenStart;
+    std::chrono::steady_clock::duration m_lexWall {};
+    uint64_t m_tokens = 0;
+
+    std::array<uint64_t, static_cast<size_t>(ASTKind::Program) + 1> m_astNodes {};
+    IRCounts m_irCodegen;
+    IRCounts m_irFinal;
+    bool m_optimized = false;
+};
+
+#endif //PJPPROJECT_STATS_HPP
@@ -0,0 +1,258 @@
+#include "TokenCache.h"
+
+#include <cassert>
+#include <cstring>
+
+#include <llvm/Support/EndianStream.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+static const char Magic[16] = "mila-tokens 1\n";
+static constexpr size_t HeaderSize = 56;
+
+static void WriteVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+static uint64_t ZigZag(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t UnZigZag(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// A location relative to an earlier one: the line difference, then the column difference on the same
+// line or the column itself on a later one
+static void WriteLocation(std::string& out, SourceLocation loc, SourceLocation base)
+{
+    WriteVarint(out, ZigZag(static_cast<int64_t>(loc.line) - base.line));
+    WriteVarint(out, ZigZag(static_cast<int64_t>(loc.column) - (loc.line == base.line ? base.column : 0)));
+}
+
+uint32_t TokenWriter::intern(llvm::StringRef string)
+{
+    auto [it, inserted] = m_Index.try_emplace(string, m_Offsets.size());
+    if (inserted) {
+        m_Offsets.push_back(m_Strings.size());
+        m_Strings.append(string.begin(), string.end());
+        m_Strings += '\0';
+    }
+    return it->second;
+}
+
+void TokenWriter::add(const LexedToken& token)
+{
+    // Most tokens are on the line the one before them ended on, two small column differences place them
+    bool sameLine = token.loc.line == m_PrevEnd.line && token.end.line == token.loc.line
+                    && token.loc.column >= m_PrevEnd.column && token.end.column >= token.loc.column
+                    && (token.tok != tok_identifier || token.end.column - token.loc.column == token.identifier.size());
+    uint8_t header = static_cast<uint8_t>(-token.tok);
+    if (token.error != nullptr)
+        header |= 0x40;
+    if (sameLine)
+        header |= 0x80;
+    m_Tokens += static_cast<char>(header);
+
+    if (sameLine) {
+        WriteVarint(m_Tokens, token.loc.column - m_PrevEnd.column);
+        if (token.tok != tok_identifier)
+            WriteVarint(m_Tokens, token.end.column - token.loc.column);
+    } else {
+        WriteLocation(m_Tokens, token.loc, m_PrevEnd);
+        WriteLocation(m_Tokens, token.end, token.loc);
+    }
+    if (token.error != nullptr)
+        WriteVarint(m_Tokens, intern(token.error));
+
+    switch (token.tok) {
+        case tok_identifier:
+            WriteVarint(m_Tokens, intern(token.identifier));
+            break;
+        case tok_number:
+            WriteVarint(m_Tokens, static_cast<uint64_t>(token.number));
+            break;
+        case tok_real: {
+            char bytes[8];
+            llvm::support::endian::write64le(bytes, llvm::DoubleToBits(token.real));
+            m_Tokens.append(bytes, sizeof(bytes));
+            break;
+        }
+        default:
+            break;
+    }
+
+    m_PrevEnd = token.end;
+    m_Complete = token.tok == tok_eof;
+}
+
+std::string TokenWriter::finish(uint64_t sourceHash, uint64_t sourceSize) const
+{
+    assert(m_Complete && "the tokens end with tok_eof");
+
+    std::string body;
+    body.reserve(m_Offsets.size() * 4 + m_Strings.size() + m_Tokens.size());
+    llvm::raw_string_ostream bodyOS(body);
+    llvm::support::endian::Writer bodyWriter(bodyOS, llvm::support::little);
+    for (uint32_t offset : m_Offsets)
+        bodyWriter.write<uint32_t>(offset);
+    bodyOS << m_Strings << m_Tokens;
+    bodyOS.flush();
+
+    std::string file;
+    file.reserve(HeaderSize + body.size());
+    llvm::raw_string_ostream os(file);
+    os.write(Magic, sizeof(Magic));
+    llvm::support::endian::Writer writer(os, llvm::support::little);
+    writer.write<uint64_t>(sourceHash);
+    writer.write<uint64_t>(sourceSize);
+    writer.write<uint32_t>(m_Offsets.size());
+    writer.write<uint32_t>(m_Strings.size());
+    writer.write<uint64_t>(m_Tokens.size());
+    writer.write<uint64_t>(llvm::xxHash64(body));
+    os << body;
+    os.flush();
+    return file;
+}
+
+bool TokenReader::open(llvm::StringRef data, uint64_t sourceHash, uint64_t sourceSize)
+{
+    using namespace llvm::support::endian;
+
+    if (data.size() < HeaderSize || memcmp(data.data(), Magic, sizeof(Magic)) != 0)
+        return false;
+    const char* header = data.data() + sizeof(Magic);
+    if (read64le(header) != sourceHash || read64le(header + 8) != sourceSize)
+        return false;
+    uint64_t stringCount = read32le(header + 16);
+    uint64_t stringBytes = read32le(header + 20);
+    uint64_t tokenBytes = read64le(header + 24);
+    if (HeaderSize + stringCount * 4 + stringBytes + tokenBytes != data.size())
+        return false;
+    // A file damaged on disk would still decode, into other tokens
+    if (llvm::xxHash64(data.drop_front(HeaderSize)) != read64le(header + 32))
+        return false;
+    // Every string ends with a NUL, an offset inside the strings always yields a terminated one
+    if (stringBytes != 0 && data[HeaderSize + stringCount * 4 + stringBytes - 1] != '\0')
+        return false;
+
+    m_Offsets = data.data() + HeaderSize;
+    m_StringCount = stringCount;
+    m_StringBytes = stringBytes;
+    m_Strings = m_Offsets + stringCount * 4;
+    m_Cur = m_Strings + stringBytes;
+    m_End = data.end();
+    m_PrevEnd = {};
+    return true;
+}
+
+bool TokenReader::readVarint(uint64_t& value)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (m_Cur == m_End)
+            return false;
+        uint8_t byte = *m_Cur++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (byte < 0x80)
+            return true;
+    }
+    return false;
+}
+
+bool TokenReader::readLocation(SourceLocation& loc, SourceLocation base)
+{
+    uint64_t line, column;
+    if (!readVarint(line) || !readVarint(column))
+        return false;
+    loc.line = base.line + UnZigZag(line);
+    loc.column = (loc.line == base.line ? base.column : 0) + UnZigZag(column);
+    return true;
+}
+
+const char* TokenReader::string(uint64_t index) const
+{
+    if (index >= m_StringCount)
+        return nullptr;
+    uint32_t offset = llvm::support::endian::read32le(m_Offsets + index * 4);
+    return offset < m_StringBytes ? m_Strings + offset : nullptr;
+}
+
+void TokenReader::next(LexedToken& token)
+{
+    if (m_Cur != m_End) {
+        uint8_t header = *m_Cur++;
+        Token tok = static_cast<Token>(-static_cast<int>(header & 0x3F));
+        bool valid = tok >= tok_real;
+        SourceLocation loc, end;
+        bool compact = header & 0x80;
+        uint64_t start, length = 0;
+        if (compact) {
+            // The length of a compact identifier is that of its string, it is placed below
+            valid = valid && readVarint(start) && (tok == tok_identifier || readVarint(length));
+            loc = {m_PrevEnd.line, static_cast<unsigned>(m_PrevEnd.column + start)};
+            end = {loc.line, static_cast<unsigned>(loc.column + length)};
+        } else {
+            valid = valid && readLocation(loc, m_PrevEnd) && readLocation(end, loc);
+        }
+
+        const char* error = nullptr;
+        uint64_t index;
+        if (valid && (header & 0x40))
+            valid = readVarint(index) && (error = string(index)) != nullptr;
+
+        if (valid) {
+            token.tok = tok;
+            token.loc = loc;
+            token.end = end;
+            token.error = error;
+
+            const char* identifier;
+            switch (tok) {
+                case tok_identifier:
+                    valid = readVarint(index) && (identifier = string(index)) != nullptr;
+                    if (valid) {
+                        token.identifier.assign(identifier);
+                        if (compact)
+                            token.end.column += token.identifier.size();
+                    }
+                    break;
+                case tok_number: {
+                    uint64_t number;
+                    valid = readVarint(number);
+                    token.number = static_cast<int64_t>(number);
+                    break;
+                }
+                case tok_real:
+                    valid = m_End - m_Cur >= 8;
+                    if (valid) {
+                        token.real = llvm::BitsToDouble(llvm::support::endian::read64le(m_Cur));
+                        m_Cur += 8;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (valid) {
+            m_PrevEnd = token.end;
+            if (tok == tok_eof)
+                m_Cur = m_End;
+            return;
+        }
+    }
+
+    // Past the end or in a damaged file the source just ends
+    m_Cur = m_End;
+    token.tok = tok_eof;
+    token.loc = token.end = m_PrevEnd;
+    token.error = nullptr;
+}
@@ -0,0 +1,75 @@
+#ifndef PJPPROJECT_TOKENCACHE_HPP
+#define PJPPROJECT_TOKENCACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+
+#include "TokenStream.h"
+
+/*
+ * The tokens of a source in a compact binary file, so a source compiled again with other options is
+ * not lexed again. The file is read in place, memory-mapped when it is large:
+ *
+ *   header     "mila-tokens 1\n" padded to 16 bytes, uint64 xxHash64 and size of the source,
+ *              uint32 number of strings and their bytes, uint64 token bytes, uint64 xxHash64 of the rest
+ *              of the file, all little endian
+ *   offsets    uint32 offset of every string
+ *   strings    identifiers and literal errors, each once and NUL-terminated, in order of first use
+ *   tokens     one record per token, tok_eof last:
+ *                byte        -tok in bits 0-5, bit 6: an error follows, bit 7: the token starts and
+ *                            ends on the line the one before it ended on
+ *                locations   bit 7 set: varints start column - previous end column, end column - start column,
+ *                            the latter left out for an identifier, whose string has that length
+ *                            bit 7 clear: zigzag varints of the line and the column of the start relative
+ *                            to the previous end, then of the end relative to the start; the column is
+ *                            relative only on the same line
+ *                error       varint string index
+ *                payload     identifier: varint string index, number: varint, real: 8 bytes
+ */
+
+// Records the tokens of a lexer, TokenStream::record passes every token it lexes
+class TokenWriter {
+public:
+    void add(const LexedToken& token);
+    bool complete() const { return m_Complete; }
+    // The file of a source with this xxHash64 and size, once tok_eof was added
+    std::string finish(uint64_t sourceHash, uint64_t sourceSize) const;
+
+private:
+    uint32_t intern(llvm::StringRef string);
+
+    std::string m_Tokens;
+    std::string m_Strings;
+    std::vector<uint32_t> m_Offsets;
+    llvm::StringMap<uint32_t> m_Index;
+    SourceLocation m_PrevEnd;
+    bool m_Complete = false;
+};
+
+// Replays the tokens of a file written by TokenWriter; the file must outlive the reader
+class TokenReader {
+public:
+    // False when data is not a token file of the source with this xxHash64 and size
+    bool open(llvm::StringRef data, uint64_t sourceHash, uint64_t sourceSize);
+    // The next token, tok_eof once the file is exhausted or damaged
+    void next(LexedToken& token);
+
+private:
+    bool readVarint(uint64_t& value);
+    bool readLocation(SourceLocation& loc, SourceLocation base);
+    const char* string(uint64_t index) const;
+
+    const char* m_Cur = nullptr;
+    const char* m_End = nullptr;
+    const char* m_Offsets = nullptr;
+    const char* m_Strings = nullptr;
+    uint32_t m_StringCount = 0;
+    uint32_t m_StringBytes = 0;
+    SourceLocation m_PrevEnd;
+};
+
+#endif //PJPPROJECT_TOKENCACHE_HPP
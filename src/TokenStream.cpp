@@ -0,0 +1,121 @@
+#include "TokenStream.h"
+#include "TokenCache.h"
+
+#include <ctime>
+
+// CPU time of the calling thread: the lexer thread also waits for the parser, which is not lexing
+static std::chrono::steady_clock::duration ThreadCPUTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+void TokenStream::lex(LexedToken& token)
+{
+    token.tok = m_Lexer.gettok();
+    token.loc = m_Lexer.tokenLoc();
+    token.end = m_Lexer.tokenEnd();
+    token.error = m_Lexer.literalError();
+    if (token.tok == tok_identifier)
+        token.identifier = m_Lexer.identifierStr();
+    else if (token.tok == tok_number)
+        token.number = m_Lexer.numVal();
+    else if (token.tok == tok_real)
+        token.real = m_Lexer.realVal();
+    if (m_Recorder != nullptr)
+        m_Recorder->add(token);
+}
+
+void TokenStream::finishRecording()
+{
+    // The parser stops at the final '.', the recording needs the rest up to tok_eof
+    if (m_Recorder == nullptr)
+        return;
+    LexedToken token;
+    while (!m_Recorder->complete())
+        lex(token);
+}
+
+void TokenStream::runAhead()
+{
+    if (m_Replay != nullptr)
+        return;
+    m_Ring = std::make_unique<LexedToken[]>(RingSize);
+    m_Thread = std::thread(&TokenStream::run, this);
+}
+
+void TokenStream::stop()
+{
+    if (!m_Thread.joinable())
+        return;
+    m_Stop.store(true, std::memory_order_relaxed);
+    m_Thread.join();
+}
+
+void TokenStream::run()
+{
+    auto start = ThreadCPUTime();
+    size_t head = 0;
+    size_t tail = 0;                    // last look at m_Tail, the ring has at least RingSize - (head - tail) free slots
+
+    while (true) {
+        while (head - tail == RingSize) {
+            tail = m_Tail.load(std::memory_order_acquire);
+            if (head - tail < RingSize)
+                break;
+            // The parser may have stopped early, after a syntax error or before trailing tokens
+            if (m_Stop.load(std::memory_order_relaxed)) {
+                m_LexTime = ThreadCPUTime() - start;
+                return;
+            }
+            std::this_thread::yield();
+        }
+
+        LexedToken& slot = m_Ring[head % RingSize];
+        lex(slot);
+        m_Tokens++;
+        m_Head.store(++head, std::memory_order_release);
+        if (slot.tok == tok_eof)
+            break;
+    }
+
+    m_LexTime = ThreadCPUTime() - start;
+}
+
+void TokenStream::next(LexedToken& token)
+{
+    if (m_Replay != nullptr) {
+        m_Replay->next(token);
+        return;
+    }
+    if (!isThreaded()) {
+        lex(token);
+        return;
+    }
+    if (m_AtEnd)
+        return;
+
+    size_t tail = m_Tail.load(std::memory_order_relaxed);
+    while (tail == m_CachedHead) {
+        m_CachedHead = m_Head.load(std::memory_order_acquire);
+        if (tail != m_CachedHead)
+            break;
+        std::this_thread::yield();
+    }
+
+    // The identifier buffers are swapped, not copied, so both sides keep reusing their allocations
+    LexedToken& slot = m_Ring[tail % RingSize];
+    token.tok = slot.tok;
+    token.loc = slot.loc;
+    token.end = slot.end;
+    token.error = slot.error;
+    if (slot.tok == tok_identifier)
+        token.identifier.swap(slot.identifier);
+    else if (slot.tok == tok_number)
+        token.number = slot.number;
+    else if (slot.tok == tok_real)
+        token.real = slot.real;
+    m_AtEnd = slot.tok == tok_eof;
+    m_Tail.store(tail + 1, std::memory_order_release);
+}
@@ -0,0 +1,89 @@
+#ifndef PJPPROJECT_TOKENSTREAM_HPP
+#define PJPPROJECT_TOKENSTREAM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "Lexer.h"
+
+class TokenReader;
+class TokenWriter;
+
+// A token with everything the parser reads of it
+struct LexedToken {
+    Token tok = tok_undefined;
+    std::string identifier;             // of tok_identifier, other tokens leave it alone
+    int64_t number = 0;                 // of tok_number, other tokens leave it alone
+    double real = 0;                    // of tok_real, other tokens leave it alone
+    const char* error = nullptr;        // what is wrong with a number, see Lexer::literalError
+    SourceLocation loc;                 // where the token starts
+    SourceLocation end;                 // just past its end
+};
+
+/*
+ * Tokens of a source for the parser. By default every token is lexed when the parser asks for it.
+ * After runAhead() a lexer thread lexes the whole source ahead of the parser into a ring buffer
+ * with one writer and one reader, so lexing overlaps with parsing and codegen on another core:
+ *
+ *   lexer thread:  lex -> m_Ring[m_Head % RingSize], publish m_Head
+ *   parser:        wait for m_Tail != m_Head, take m_Ring[m_Tail % RingSize], publish m_Tail
+ *
+ * Neither side locks, each index is written by one thread only and the slots between them belong to
+ * the other one. A full or empty ring makes the waiting side yield its core.
+ *
+ * Tokens cached by an earlier compilation of the same source are replayed instead of lexed, see
+ * TokenCache.h.
+ */
+class TokenStream {
+public:
+    explicit TokenStream(llvm::StringRef source)
+            : m_Lexer(source) {}
+    ~TokenStream() { stop(); }
+
+    // Passes every lexed token to `recorder`, set before the first token is taken
+    void record(TokenWriter* recorder) { m_Recorder = recorder; }
+    // Takes the tokens from `replay` instead of the lexer, set before the first token is taken
+    void replay(TokenReader* replay) { m_Replay = replay; }
+    // Lexes what the parser left of the source into the recorder, after stop()
+    void finishRecording();
+
+    // Starts the lexer thread, before the first token is taken; replayed tokens need no thread
+    void runAhead();
+    // Stops the lexer thread, whether or not it reached the end of the source
+    void stop();
+    bool isThreaded() const { return m_Ring != nullptr; }
+
+    // Replaces `token` with the next token, at the end of the source it stays tok_eof
+    void next(LexedToken& token);
+
+    // CPU time and tokens of the lexer thread, once it is stopped
+    std::chrono::steady_clock::duration lexTime() const { return m_LexTime; }
+    uint64_t tokenCount() const { return m_Tokens; }
+
+private:
+    static constexpr size_t RingSize = 4096;    // a power of two
+
+    void lex(LexedToken& token);
+    void run();
+
+    Lexer m_Lexer;
+    TokenWriter* m_Recorder = nullptr;
+    TokenReader* m_Replay = nullptr;
+
+    std::unique_ptr<LexedToken[]> m_Ring;
+    std::thread m_Thread;
+    alignas(64) std::atomic<size_t> m_Head { 0 };    // next slot the lexer fills
+    alignas(64) std::atomic<size_t> m_Tail { 0 };    // next slot the parser takes
+    alignas(64) std::atomic<bool> m_Stop { false };
+    size_t m_CachedHead = 0;            // the parser's last look at m_Head
+    bool m_AtEnd = false;               // the parser took tok_eof
+
+    std::chrono::steady_clock::duration m_LexTime {};
+    uint64_t m_Tokens = 0;
+};
+
+#endif //PJPPROJECT_TOKENSTREAM_HPP
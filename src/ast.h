@@ -1,5 +1,4 @@
 #pragma once
-#include <map>
 #include <memory>
 #include <ostream>
 #include <vector>
@@ -8,23 +7,37 @@
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 
+#include "DebugInfo.h"
+#include "Diagnostics.h"
 #include "Lexer.h"
+#include "Profile.h"
 
 
-class TypeASTNode;
-
 enum class Type { INT,
-    DOUBLE
+    DOUBLE,
+    BOOL                                // of comparisons and logic over them, nothing is declared with it
 };
 
+// A declared name. Sema gives every declaration one and resolves every reference to its index in
+// GenContext::symbols; symbols outlive the declarations they come from, which may be freed as soon as
+// they are generated
 struct Symbol {
     std::string name;
-    TypeASTNode * type;
-    llvm::AllocaInst* store;
-    int numberOfElements;
-    int offset;
+    Type type;                          // of a variable or constant, of the elements of an array
+    bool constant = false;
+    int numberOfElements = 0;           // of an array, 0 for a variable or constant
+    int offset = 0;                     // lower bound of an array
+    llvm::AllocaInst* store = nullptr;  // set when codegen emits the declaration
 };
 
+constexpr unsigned NoSymbol = ~0u;
+
+
+// Jump targets of the innermost enclosing loop
+struct LoopContext {
+    llvm::BasicBlock* BBbreak;
+    llvm::BasicBlock* BBcontinue;
+};
 
 struct GenContext {
     GenContext(const std::string moduleName)
@@ -32,19 +45,72 @@ struct GenContext {
             , module(moduleName, ctx)
     {
     }
-    llvm::BasicBlock* BBreak;
+    std::vector<LoopContext> loops;
     llvm::LLVMContext ctx;
     llvm::IRBuilder<> builder;
     llvm::Module module;
 
-    std::map<std::string, Symbol> symbolTable;
+    std::vector<Symbol> symbols;        // filled by Sema, codegen sets their stores
+
+    BranchProfile* profile = nullptr;   // counts or weighs the branches of if/while/for when set
+    LineProfile* lineProfile = nullptr; // counts executions of statements and loop iterations when set
+    DebugInfo* debugInfo = nullptr;     // attributes instructions to source lines when set
+    SourceLocation loc;                 // of the statement being generated
+
+    // True once the current block ends with a terminator, nothing may be emitted into it anymore
+    bool isTerminated() const { return builder.GetInsertBlock()->getTerminator() != nullptr; }
+};
+
+/*
+ * Kind of every concrete node, used for LLVM-style RTTI (isa/cast/dyn_cast) and visitor dispatch.
+ * Nodes of one category are kept in a contiguous range, so classof of a base class is a range check.
+ */
+enum class ASTKind {
+    Type,
+
+    // ExprASTNode
+    BinOp,
+    UnaryOp,
+    Literal,
+    FloatLiteral,
+    // VarASTNode
+    DeclRef,
+    DeclArrayRef,
+
+    // StatementASTNode
+    If,
+    While,
+    Break,
+    Continue,
+    FunCall,
+    ConstDecl,
+    VarDecl,
+    ArrayDecl,
+    Assign,
+    For,
+
+    Program
 };
 
+const char* getKindName(ASTKind kind);
+
 class ASTNode {
 public:
+    ASTNode(ASTKind kind)
+            : m_kind(kind) {}
     virtual ~ASTNode();
     void gen() const;
-    virtual llvm::Value* codegen(GenContext& gen) const = 0;
+    // Switches on the kind to the codegen of the concrete node, none of them is virtual
+    llvm::Value* codegen(GenContext& gen) const;
+
+    ASTKind getKind() const { return m_kind; }
+
+    SourceLocation getLocation() const { return m_loc; }
+    void setLocation(SourceLocation loc) { m_loc = loc; }
+
+private:
+    const ASTKind m_kind;
+    SourceLocation m_loc;
 };
 
 
@@ -52,8 +118,11 @@ class TypeASTNode : public ASTNode {
 public:
 
     TypeASTNode(Type type);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
     llvm::Type* genType(GenContext& gen) const;
+    Type getType() const { return m_type; }
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::Type; }
 
 private:
     Type m_type;
@@ -62,8 +131,31 @@ private:
 
 class ExprASTNode : public ASTNode {
 public:
-    ExprASTNode() {}
+    ExprASTNode(ASTKind kind)
+            : ASTNode(kind) {}
     virtual ~ExprASTNode();
+    // Emits the expression as a branch condition: jumps to BBtrue when it holds, otherwise to BBfalse
+    void condgen(GenContext& gen, llvm::BasicBlock* BBtrue, llvm::BasicBlock* BBfalse) const;
+    // True if the expression yields a truth value (comparison or logic over comparisons)
+    bool isBoolean() const { return m_type == Type::BOOL; }
+    // True if the expression can be evaluated eagerly: no loads that may be out of bounds, no division traps
+    bool isSpeculatable() const;
+
+    // The type of the value, set by Sema
+    Type getType() const { return m_type; }
+    void setType(Type type) { m_type = type; }
+
+    static bool classof(const ASTNode* node)
+    {
+        return node->getKind() >= ASTKind::BinOp && node->getKind() <= ASTKind::DeclArrayRef;
+    }
+
+protected:
+    // condgen of any expression: computes the value and branches on it
+    void branchOnValue(GenContext& gen, llvm::BasicBlock* BBtrue, llvm::BasicBlock* BBfalse) const;
+
+private:
+    Type m_type = Type::INT;
 };
 
 
@@ -72,11 +164,16 @@ public:
     Token m_op;
     std::unique_ptr<ExprASTNode> m_lhs;
     std::unique_ptr<ExprASTNode> m_rhs;
+    Type m_operandType = Type::INT;     // both operands are converted to it, set by Sema
 
     BinOpASTNode ( Token op )
-            : m_op ( op ) {}
+            : ExprASTNode ( ASTKind::BinOp ), m_op ( op ) {}
     BinOpASTNode(Token op, std::unique_ptr<ExprASTNode> lhs, std::unique_ptr<ExprASTNode> rhs);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
+    void condgen(GenContext& gen, llvm::BasicBlock* BBtrue, llvm::BasicBlock* BBfalse) const;
+    bool isSpeculatable() const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::BinOp; }
 };
 
 class UnaryOpASTNode : public ExprASTNode {
@@ -85,7 +182,14 @@ class UnaryOpASTNode : public ExprASTNode {
 
 public:
     UnaryOpASTNode(Token op, std::unique_ptr<ExprASTNode> expr);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
+    void condgen(GenContext& gen, llvm::BasicBlock* BBtrue, llvm::BasicBlock* BBfalse) const;
+    bool isSpeculatable() const;
+    Token getOp() const { return m_op; }
+    const ExprASTNode* getExpr() const { return m_expr.get(); }
+    ExprASTNode* getExpr() { return m_expr.get(); }
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::UnaryOp; }
 };
 
 class LiteralASTNode : public ExprASTNode {
@@ -93,42 +197,76 @@ class LiteralASTNode : public ExprASTNode {
 
 public:
     LiteralASTNode(int64_t value);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
+    int64_t getValue() const { return m_value; }
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::Literal; }
+};
+
+class FloatLiteralASTNode : public ExprASTNode {
+    double m_value;
+
+public:
+    FloatLiteralASTNode(double value);
+    llvm::Value* codegen(GenContext& gen) const;
+    double getValue() const { return m_value; }
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::FloatLiteral; }
 };
 
 class VarASTNode : public ExprASTNode {
 public:
     std::string m_var;
-    virtual llvm::Value* getStore(GenContext& gen) const = 0;
+    unsigned m_symbol = NoSymbol;       // of the declaration of m_var, resolved by Sema
+
+    VarASTNode(ASTKind kind)
+            : ExprASTNode(kind) {}
+    VarASTNode(ASTKind kind, std::string var)
+            : ExprASTNode(kind), m_var(std::move(var)) {}
+    llvm::Value* getStore(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node)
+    {
+        return node->getKind() >= ASTKind::DeclRef && node->getKind() <= ASTKind::DeclArrayRef;
+    }
 };
 
 
 class DeclRefASTNode : public VarASTNode {
 public:
-    std::string m_var;
-
-    DeclRefASTNode() {}
+    DeclRefASTNode()
+            : VarASTNode(ASTKind::DeclRef) {}
     DeclRefASTNode(std::string var);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
     llvm::AllocaInst* getStore(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::DeclRef; }
 };
 
 class DeclArrayRefASTNode : public VarASTNode {
 public:
-    std::string m_var;
-    std::unique_ptr<ExprASTNode> m_index;
+    std::unique_ptr<ExprASTNode> m_index;   // as written, codegen subtracts the lower bound
 
-    DeclArrayRefASTNode() {}
+    DeclArrayRefASTNode()
+            : VarASTNode(ASTKind::DeclArrayRef) {}
     DeclArrayRefASTNode(std::string var, std::unique_ptr<ExprASTNode> index);
-    DeclArrayRefASTNode(std::string var) : m_var(var) {}
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
     llvm::Value* getStore(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::DeclArrayRef; }
 };
 
 
 class StatementASTNode : public ASTNode {
 public:
+    StatementASTNode(ASTKind kind)
+            : ASTNode(kind) {}
     virtual ~StatementASTNode();
+
+    static bool classof(const ASTNode* node)
+    {
+        return node->getKind() >= ASTKind::If && node->getKind() <= ASTKind::For;
+    }
 };
 
 
@@ -138,9 +276,12 @@ public:
     std::vector<std::unique_ptr<StatementASTNode>> m_bodyTrue;
     std::vector<std::unique_ptr<StatementASTNode>> m_bodyFalse;
 
-    IfASTNode() {}
+    IfASTNode()
+            : StatementASTNode(ASTKind::If) {}
     IfASTNode(std::unique_ptr<ExprASTNode> cond, std::vector<std::unique_ptr<StatementASTNode>> body);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::If; }
 };
 
 class WhileASTNode : public StatementASTNode {
@@ -148,16 +289,32 @@ public:
     std::unique_ptr<ExprASTNode> m_cond;
     std::vector<std::unique_ptr<StatementASTNode>> m_body;
 
-    WhileASTNode() {}
+    WhileASTNode()
+            : StatementASTNode(ASTKind::While) {}
     WhileASTNode(std::unique_ptr<ExprASTNode> cond, std::vector<std::unique_ptr<StatementASTNode>> body);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::While; }
 };
 
 class BreakASTNode : public StatementASTNode {
 public:
 
-    BreakASTNode() {}
-    llvm::Value* codegen(GenContext& gen) const override;
+    BreakASTNode()
+            : StatementASTNode(ASTKind::Break) {}
+    llvm::Value* codegen(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::Break; }
+};
+
+class ContinueASTNode : public StatementASTNode {
+public:
+
+    ContinueASTNode()
+            : StatementASTNode(ASTKind::Continue) {}
+    llvm::Value* codegen(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::Continue; }
 };
 
 
@@ -168,9 +325,11 @@ public:
     std::vector<std::unique_ptr<ExprASTNode>> m_Exprs;
 
     FunCallASTNode(std::string func )
-            : m_func(func) {}
+            : StatementASTNode(ASTKind::FunCall), m_func(func) {}
     FunCallASTNode(std::string func, std::vector<std::unique_ptr<VarASTNode>> args);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::FunCall; }
 };
 
 
@@ -178,20 +337,28 @@ class ConstDeclASTNode : public StatementASTNode {
 public:
     std::string m_const;
     std::unique_ptr<ExprASTNode> m_expr;
+    unsigned m_symbol = NoSymbol;       // declared by Sema
 
-    ConstDeclASTNode () {}
+    ConstDeclASTNode()
+            : StatementASTNode(ASTKind::ConstDecl) {}
     ConstDeclASTNode(std::string nameOfConst, std::unique_ptr<ExprASTNode> expr);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::ConstDecl; }
 };
 
 class VarDeclASTNode : public StatementASTNode {
 public:
     std::string m_var;
     std::unique_ptr<TypeASTNode> m_type;
+    unsigned m_symbol = NoSymbol;       // declared by Sema
 
-    VarDeclASTNode () {}
+    VarDeclASTNode()
+            : StatementASTNode(ASTKind::VarDecl) {}
     VarDeclASTNode(std::string var, std::unique_ptr<TypeASTNode> type);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::VarDecl; }
 };
 
 class ArrayDeclASTNode : public StatementASTNode {
@@ -200,10 +367,14 @@ public:
     std::unique_ptr<TypeASTNode> m_type;
     int m_lowerBound;
     int m_upperBound;
+    unsigned m_symbol = NoSymbol;       // declared by Sema
 
-    ArrayDeclASTNode() {}
+    ArrayDeclASTNode()
+            : StatementASTNode(ASTKind::ArrayDecl) {}
     ArrayDeclASTNode(std::string var, std::unique_ptr<TypeASTNode> type, int lowerBound, int upperBound);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::ArrayDecl; }
 };
 
 class AssignASTNode : public StatementASTNode {
@@ -211,9 +382,12 @@ public:
     std::unique_ptr<VarASTNode> m_var;
     std::unique_ptr<ExprASTNode> m_expr;
 
-    AssignASTNode() {}
+    AssignASTNode()
+            : StatementASTNode(ASTKind::Assign) {}
     AssignASTNode(std::unique_ptr<VarASTNode> var, std::unique_ptr<ExprASTNode> expr);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::Assign; }
 };
 
 class ForASTNode : public StatementASTNode {
@@ -223,19 +397,32 @@ public:
     std::unique_ptr<AssignASTNode> m_increment;
     std::vector<std::unique_ptr<StatementASTNode>> m_body;
 
-    ForASTNode() {}
+    ForASTNode()
+            : StatementASTNode(ASTKind::For) {}
     ForASTNode(std::unique_ptr<AssignASTNode> initialization, std::unique_ptr<ExprASTNode> condition,
                std::unique_ptr<AssignASTNode> increment, std::vector<std::unique_ptr<StatementASTNode>> body);
 
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::For; }
 };
 
 class ProgramASTNode : public ASTNode {
 public:
     std::string nameOfProgram;
     std::vector<std::unique_ptr<StatementASTNode>> m_statements;
+    SourceLocation m_endLoc;            // the final 'end.', where main returns
 
-    ProgramASTNode() {}
+    ProgramASTNode()
+            : ASTNode(ASTKind::Program) {}
     ProgramASTNode(std::vector<std::unique_ptr<StatementASTNode>> statements);
-    llvm::Value* codegen(GenContext& gen) const override;
+    llvm::Value* codegen(GenContext& gen) const;
+
+    // codegen in pieces, for statements generated one by one as the parser finishes them:
+    // main is opened, every statement is emitted into it in order, then main returns at m_endLoc
+    void codegenEntry(GenContext& gen) const;
+    static void codegenStatement(GenContext& gen, const StatementASTNode& statement);
+    void codegenExit(GenContext& gen) const;
+
+    static bool classof(const ASTNode* node) { return node->getKind() == ASTKind::Program; }
 };
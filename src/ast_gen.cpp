@@ -1,11 +1,39 @@
 #include <llvm/ADT/APFloat.h>
 #include <llvm/IR/BasicBlock.h>
+#include <llvm/Support/TimeProfiler.h>
 #include <ostream>
 #include "ast.h"
 
-void FloatingPointError()
+static llvm::Type* LLVMType(GenContext& gen, Type type)
 {
-    throw std::runtime_error("Error with usage of floating point");
+    switch (type) {
+        case Type::DOUBLE:
+            return llvm::Type::getDoubleTy(gen.ctx);
+        case Type::INT:
+            return llvm::Type::getInt32Ty(gen.ctx);
+        case Type::BOOL:
+            return llvm::Type::getInt1Ty(gen.ctx);
+    }
+    llvm_unreachable("unknown type");
+}
+
+// A value of one type as another, Sema chose both: truth values widen to 0 and 1, integers and truth
+// values to reals
+static llvm::Value* Convert(GenContext& gen, llvm::Value* value, Type from, Type to)
+{
+    if (from == to)
+        return value;
+    if (to == Type::DOUBLE)
+        return from == Type::BOOL ? gen.builder.CreateUIToFP(value, LLVMType(gen, to))
+                                  : gen.builder.CreateSIToFP(value, LLVMType(gen, to));
+    assert(from == Type::BOOL && to == Type::INT && "reals are never converted to integers");
+    return gen.builder.CreateZExt(value, LLVMType(gen, to));
+}
+
+// Generates an expression as a value of the given type
+static llvm::Value* CodegenAs(GenContext& gen, const ExprASTNode& expr, Type type)
+{
+    return Convert(gen, expr.codegen(gen), expr.getType(), type);
 }
 
 void ASTNode::gen() const
@@ -15,171 +43,217 @@ void ASTNode::gen() const
     gen.module.print(llvm::outs(), nullptr);
 }
 
+llvm::Value* ASTNode::codegen(GenContext& gen) const
+{
+    switch (getKind()) {
+        case ASTKind::Type:
+            return llvm::cast<TypeASTNode>(this)->codegen(gen);
+        case ASTKind::BinOp:
+            return llvm::cast<BinOpASTNode>(this)->codegen(gen);
+        case ASTKind::UnaryOp:
+            return llvm::cast<UnaryOpASTNode>(this)->codegen(gen);
+        case ASTKind::Literal:
+            return llvm::cast<LiteralASTNode>(this)->codegen(gen);
+        case ASTKind::FloatLiteral:
+            return llvm::cast<FloatLiteralASTNode>(this)->codegen(gen);
+        case ASTKind::DeclRef:
+            return llvm::cast<DeclRefASTNode>(this)->codegen(gen);
+        case ASTKind::DeclArrayRef:
+            return llvm::cast<DeclArrayRefASTNode>(this)->codegen(gen);
+        case ASTKind::If:
+            return llvm::cast<IfASTNode>(this)->codegen(gen);
+        case ASTKind::While:
+            return llvm::cast<WhileASTNode>(this)->codegen(gen);
+        case ASTKind::Break:
+            return llvm::cast<BreakASTNode>(this)->codegen(gen);
+        case ASTKind::Continue:
+            return llvm::cast<ContinueASTNode>(this)->codegen(gen);
+        case ASTKind::FunCall:
+            return llvm::cast<FunCallASTNode>(this)->codegen(gen);
+        case ASTKind::ConstDecl:
+            return llvm::cast<ConstDeclASTNode>(this)->codegen(gen);
+        case ASTKind::VarDecl:
+            return llvm::cast<VarDeclASTNode>(this)->codegen(gen);
+        case ASTKind::ArrayDecl:
+            return llvm::cast<ArrayDeclASTNode>(this)->codegen(gen);
+        case ASTKind::Assign:
+            return llvm::cast<AssignASTNode>(this)->codegen(gen);
+        case ASTKind::For:
+            return llvm::cast<ForASTNode>(this)->codegen(gen);
+        case ASTKind::Program:
+            return llvm::cast<ProgramASTNode>(this)->codegen(gen);
+    }
+    llvm_unreachable("unknown AST node kind");
+}
+
 llvm::Value* TypeASTNode::codegen(GenContext& gen) const { return nullptr; }
 
 llvm::Type* TypeASTNode::genType(GenContext& gen) const
 {
-    switch (m_type) {
-        case Type::DOUBLE:
-            return llvm::Type::getDoubleTy(gen.ctx);
-        case Type::INT:
-            return llvm::Type::getInt32Ty(gen.ctx);
-        default:
-            assert(false);
-    }
+    return LLVMType(gen, m_type);
 }
 
 llvm::Value* BinOpASTNode::codegen(GenContext& gen) const
 {
     auto lhs = m_lhs->codegen(gen);
     auto rhs = m_rhs->codegen(gen);
+    lhs = Convert(gen, lhs, m_lhs->getType(), m_operandType);
+    rhs = Convert(gen, rhs, m_rhs->getType(), m_operandType);
+    bool dblArith = m_operandType == Type::DOUBLE;
 
-    assert(lhs);
-    assert(rhs);
-
-    bool dblArith = lhs->getType()->isDoubleTy() || rhs->getType()->isDoubleTy();
-    auto maybeSIToFP = [&gen](llvm::Value* val) {
-        if (!val->getType()->isDoubleTy())
-            return gen.builder.CreateSIToFP(val, llvm::Type::getDoubleTy(gen.ctx));
-        return val;
-    };
-
+    // Sema reported every operator reals do not have
     switch (m_op) {
         case Token::tok_sum:
             if (dblArith)
-                return gen.builder.CreateFAdd(maybeSIToFP(lhs), maybeSIToFP(rhs), "add");
+                return gen.builder.CreateFAdd(lhs, rhs, "add");
             else
                 return gen.builder.CreateAdd(lhs, rhs, "add");
         case Token::tok_substract:
             if (dblArith)
-                return gen.builder.CreateFSub(maybeSIToFP(lhs), maybeSIToFP(rhs), "sub");
+                return gen.builder.CreateFSub(lhs, rhs, "sub");
             else
                 return gen.builder.CreateSub(lhs, rhs, "sub");
         case Token::tok_multiply:
             if (dblArith)
-                return gen.builder.CreateFMul(maybeSIToFP(lhs), maybeSIToFP(rhs), "mul");
+                return gen.builder.CreateFMul(lhs, rhs, "mul");
             else
                 return gen.builder.CreateMul(lhs, rhs, "mul");
-
         case Token::tok_mod:
-            if (dblArith)
-            {
-                // Error: Modulus operation not supported for floating-point arithmetic
-                FloatingPointError();
-            }
-            else
-                return gen.builder.CreateSRem(lhs, rhs, "mod");
+            return gen.builder.CreateSRem(lhs, rhs, "mod");
         case Token::tok_div:
             if (dblArith)
-                return gen.builder.CreateFDiv(maybeSIToFP(lhs), maybeSIToFP(rhs), "div");
+                return gen.builder.CreateFDiv(lhs, rhs, "div");
             else
                 return gen.builder.CreateSDiv(lhs, rhs, "div");
         case Token::tok_greater:
-            if (dblArith)
-            {
-                // Error: Greater-than operation not supported for floating-point arithmetic
-                FloatingPointError();
-            }
-            else
-                return gen.builder.CreateICmpSGT(lhs, rhs, "greater");
-
+            return gen.builder.CreateICmpSGT(lhs, rhs, "greater");
         case Token::tok_less:
-            if (dblArith)
-            {
-                // Error: Less-than operation not supported for floating-point arithmetic
-                FloatingPointError();
-            }
-            else
-                return gen.builder.CreateICmpSLT(lhs, rhs, "less");
-
+            return gen.builder.CreateICmpSLT(lhs, rhs, "less");
         case Token::tok_greaterequal:
-            if (dblArith)
-            {
-                // Error: Greater-than-or-equal operation not supported for floating-point arithmetic
-                FloatingPointError();
-            }
-            else
-                return gen.builder.CreateICmpSGE(lhs, rhs, "greaterequal");
-
+            return gen.builder.CreateICmpSGE(lhs, rhs, "greaterequal");
         case Token::tok_lessequal:
-            if (dblArith)
-            {
-                // Error: Less-than-or-equal operation not supported for floating-point arithmetic
-                FloatingPointError();
-            }
-            else
-                return gen.builder.CreateICmpSLE(lhs, rhs, "lessequal");
-
+            return gen.builder.CreateICmpSLE(lhs, rhs, "lessequal");
         case Token::tok_notequal:
-            if (dblArith)
-            {
-                // Error: Not-equal operation not supported for floating-point arithmetic
-                FloatingPointError();
-            }
-            else
-                return gen.builder.CreateICmpNE(lhs, rhs, "notequal");
-
+            return gen.builder.CreateICmpNE(lhs, rhs, "notequal");
         case Token::tok_xor:
-            if (dblArith)
-            {
-                // Error: XOR operation not supported for floating-point arithmetic
-                FloatingPointError();
-            }
-            else
-                return gen.builder.CreateXor(lhs, rhs, "xor");
-
+            return gen.builder.CreateXor(lhs, rhs, "xor");
         case Token::tok_and:
-            if (dblArith)
-            {
-                // Error: AND operation not supported for floating-point arithmetic
-                FloatingPointError();
-            }
-            else
-                return gen.builder.CreateAnd(lhs, rhs, "and");
-
+            return gen.builder.CreateAnd(lhs, rhs, "and");
         case Token::tok_or:
-            if (dblArith)
-            {
-                // Error: OR operation not supported for floating-point arithmetic
-                FloatingPointError();
-            }
-            else
-                return gen.builder.CreateOr(lhs, rhs, "or");
+            return gen.builder.CreateOr(lhs, rhs, "or");
         case Token::tok_equal:
             if (dblArith)
-                return gen.builder.CreateFCmpOEQ(maybeSIToFP(lhs), maybeSIToFP(rhs), "eq");
+                return gen.builder.CreateFCmpOEQ(lhs, rhs, "eq");
             else
                 return gen.builder.CreateICmpEQ(lhs, rhs, "eq");
         default:
-            throw "unimplemented";
+            llvm_unreachable("the parser only builds the operators above");
+    }
+}
+
+void ExprASTNode::condgen(GenContext& gen, llvm::BasicBlock* BBtrue, llvm::BasicBlock* BBfalse) const
+{
+    switch (getKind()) {
+        case ASTKind::BinOp:
+            return llvm::cast<BinOpASTNode>(this)->condgen(gen, BBtrue, BBfalse);
+        case ASTKind::UnaryOp:
+            return llvm::cast<UnaryOpASTNode>(this)->condgen(gen, BBtrue, BBfalse);
+        default:
+            return branchOnValue(gen, BBtrue, BBfalse);
+    }
+}
+
+bool ExprASTNode::isSpeculatable() const
+{
+    switch (getKind()) {
+        case ASTKind::BinOp:
+            return llvm::cast<BinOpASTNode>(this)->isSpeculatable();
+        case ASTKind::UnaryOp:
+            return llvm::cast<UnaryOpASTNode>(this)->isSpeculatable();
+        case ASTKind::Literal:
+        case ASTKind::FloatLiteral:
+        case ASTKind::DeclRef:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void ExprASTNode::branchOnValue(GenContext& gen, llvm::BasicBlock* BBtrue, llvm::BasicBlock* BBfalse) const
+{
+    llvm::Value* cond = codegen(gen);
+
+    // Integers and doubles are true when non-zero
+    if (getType() == Type::DOUBLE)
+        cond = gen.builder.CreateFCmpONE(cond, llvm::ConstantFP::get(cond->getType(), 0.0), "tobool");
+    else if (getType() == Type::INT)
+        cond = gen.builder.CreateICmpNE(cond, llvm::ConstantInt::get(cond->getType(), 0), "tobool");
+
+    gen.builder.CreateCondBr(cond, BBtrue, BBfalse);
+}
+
+bool BinOpASTNode::isSpeculatable() const
+{
+    if (m_op == Token::tok_div || m_op == Token::tok_mod)
+        return false;
+    return m_lhs->isSpeculatable() && m_rhs->isSpeculatable();
+}
+
+void BinOpASTNode::condgen(GenContext& gen, llvm::BasicBlock* BBtrue, llvm::BasicBlock* BBfalse) const
+{
+    // On integers 'and'/'or' are bitwise, only truth values may be short-circuited
+    bool logical = (m_op == Token::tok_and || m_op == Token::tok_or) && isBoolean();
+
+    // A cheap right operand is evaluated eagerly, an and/or of two i1 values beats an extra branch
+    if (!logical || m_rhs->isSpeculatable()) {
+        branchOnValue(gen, BBtrue, BBfalse);
+        return;
+    }
+
+    auto parent = gen.builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock* BBrhs = llvm::BasicBlock::Create(gen.ctx, m_op == Token::tok_and ? "and.rhs" : "or.rhs", parent, BBtrue);
+
+    // The right operand is only evaluated when the left one does not decide the result
+    if (m_op == Token::tok_and)
+        m_lhs->condgen(gen, BBrhs, BBfalse);
+    else
+        m_lhs->condgen(gen, BBtrue, BBrhs);
+
+    gen.builder.SetInsertPoint(BBrhs);
+    m_rhs->condgen(gen, BBtrue, BBfalse);
+}
+
+bool UnaryOpASTNode::isSpeculatable() const
+{
+    return m_expr->isSpeculatable();
+}
+
+void UnaryOpASTNode::condgen(GenContext& gen, llvm::BasicBlock* BBtrue, llvm::BasicBlock* BBfalse) const
+{
+    // 'not' over a truth value just swaps the targets
+    if (isBoolean()) {
+        m_expr->condgen(gen, BBfalse, BBtrue);
+        return;
     }
+    branchOnValue(gen, BBtrue, BBfalse);
 }
 
 llvm::Value* UnaryOpASTNode::codegen(GenContext& gen) const
 {
     auto expr = m_expr->codegen(gen);
 
-    assert(expr);
-
     switch (m_op) {
         case Token::tok_not:
-            if (expr->getType()->isDoubleTy())
-            {
-                // Error: Logical NOT operation not supported for double type
-                FloatingPointError();
-            }
-            else
-                return gen.builder.CreateNot(expr, "unnot");
+            return gen.builder.CreateNot(expr, "unnot");
         default:
-            throw "unimplemented";
+            llvm_unreachable("the parser only builds 'not'");
     }
 }
 
 llvm::Value* AssignASTNode::codegen(GenContext& gen) const
 {
     auto* store = m_var->getStore(gen);
-    auto expr = m_expr->codegen(gen);
-
+    auto expr = CodegenAs(gen, *m_expr, m_var->getType());
     gen.builder.CreateStore(expr, store);
     return nullptr;
 }
@@ -189,49 +263,49 @@ llvm::Value* LiteralASTNode::codegen(GenContext& gen) const
     return llvm::ConstantInt::get(llvm::Type::getInt32Ty(gen.ctx), m_value);
 }
 
+llvm::Value* FloatLiteralASTNode::codegen(GenContext& gen) const
+{
+    return llvm::ConstantFP::get(llvm::Type::getDoubleTy(gen.ctx), m_value);
+}
+
+// Address of an element, the elements are stored from the lower bound on
+static llvm::Value* ElementAddress(GenContext& gen, const DeclArrayRefASTNode& ref)
+{
+    const Symbol& symbol = gen.symbols[ref.m_symbol];
+
+    llvm::Value* index = CodegenAs(gen, *ref.m_index, Type::INT);
+    index = gen.builder.CreateSub(index, gen.builder.getInt32(symbol.offset), "sub");
+
+    llvm::ArrayType* arrayType = llvm::ArrayType::get(LLVMType(gen, symbol.type), symbol.numberOfElements);
+    llvm::Value * ind [] { gen.builder.getInt64(0), index};
+    return gen.builder.CreateGEP(arrayType, symbol.store, ind, ref.m_var + "_index");
+}
+
 
 llvm::Value* DeclRefASTNode::codegen(GenContext& gen) const
 {
-    assert(gen.symbolTable.contains(m_var));
-    const auto& symbol = gen.symbolTable[m_var];
+    const Symbol& symbol = gen.symbols[m_symbol];
+    return gen.builder.CreateLoad(LLVMType(gen, symbol.type), symbol.store, m_var);
+}
 
-    return gen.builder.CreateLoad(symbol.type->genType(gen), symbol.store, m_var);
+llvm::Value* VarASTNode::getStore(GenContext& gen) const
+{
+    if (auto* ref = llvm::dyn_cast<DeclRefASTNode>(this))
+        return ref->getStore(gen);
+    return llvm::cast<DeclArrayRefASTNode>(this)->getStore(gen);
 }
 
 llvm::AllocaInst* DeclRefASTNode::getStore(GenContext& gen) const
 {
-    assert(gen.symbolTable.contains(m_var));
-    return gen.symbolTable[m_var].store;
+    return gen.symbols[m_symbol].store;
 }
 
 llvm::Value* DeclArrayRefASTNode::codegen(GenContext& gen) const {
-    assert(gen.symbolTable.contains(m_var));
-    const auto& symbol = gen.symbolTable[m_var];
-
-    llvm::Value* indexValue = m_index->codegen(gen);
-
-    llvm::ArrayType* arrayType = llvm::ArrayType::get(llvm::Type::getInt32Ty(gen.ctx), symbol.numberOfElements);
-
-    // Get the element pointer using the index value
-    llvm::Value * ind [] { gen.builder.getInt64(0), indexValue};
-    auto elementPtr = gen.builder.CreateGEP(arrayType, symbol.store, ind, m_var + "_index");
-    return gen.builder.CreateLoad(llvm::Type::getInt32Ty(gen.ctx), elementPtr);
+    return gen.builder.CreateLoad(LLVMType(gen, getType()), ElementAddress(gen, *this));
 }
 
 llvm::Value* DeclArrayRefASTNode::getStore(GenContext& gen) const {
-    assert(gen.symbolTable.contains(m_var));
-    const auto& symbol = gen.symbolTable[m_var];
-
-    llvm::Value* indexValue = m_index->codegen(gen);
-
-    llvm::ArrayType* arrayType = llvm::ArrayType::get(llvm::Type::getInt32Ty(gen.ctx), symbol.numberOfElements);
-
-    // Get the element pointer using the index value
-    llvm::Value * ind [] { gen.builder.getInt64(0), indexValue};
-    auto elementPtr = gen.builder.CreateGEP(arrayType, symbol.store, ind, m_var + "_index");
-
-    return  elementPtr;
-
+    return ElementAddress(gen, *this);
 }
 
 llvm::Value* FunCallASTNode::codegen(GenContext& gen) const
@@ -245,50 +319,102 @@ llvm::Value* FunCallASTNode::codegen(GenContext& gen) const
         for (const auto & ref : m_Refs )
             args . emplace_back(ref ->getStore(gen));
     } else {
+        // Truth values are printed as integers
         for (const auto& arg : m_Exprs)
-            args.emplace_back(arg->codegen(gen));
+            args.emplace_back(CodegenAs(gen, *arg, arg->getType() == Type::BOOL ? Type::INT : arg->getType()));
+    }
+
+    // Reals are printed by runtime functions of their own, declared when a program needs them
+    if (m_Exprs.size() == 1 && m_Exprs[0]->getType() == Type::DOUBLE) {
+        auto printReal = gen.module.getOrInsertFunction(m_func + "_real", gen.builder.getVoidTy(), gen.builder.getDoubleTy());
+        func = llvm::cast<llvm::Function>(printReal.getCallee());
     }
 
-    return gen.builder.CreateCall(func, args);
+    llvm::CallInst* call = gen.builder.CreateCall(func, args);
+
+    // Calls that receive no pointer into the caller's frame may be marked 'tail',
+    // the callee then cannot touch our allocas and the backend is free to reuse the frame
+    bool passesFrame = llvm::any_of(args, [](llvm::Value* arg) { return arg->getType()->isPointerTy(); });
+    if (!passesFrame)
+        call->setTailCall();
+
+    return call;
 }
 
 
+// Attributes the instructions emitted next to a source location, when debug info is generated
+static void setDebugLocation(GenContext& gen, SourceLocation loc)
+{
+    if (gen.debugInfo != nullptr)
+        gen.debugInfo->setLocation(gen.builder, loc);
+}
+
+static void emitStatement(GenContext& gen, const StatementASTNode& statement)
+{
+    llvm::TimeTraceScope traceScope("ASTNode::codegen", getKindName(statement.getKind()));
+    gen.loc = statement.getLocation();
+    setDebugLocation(gen, gen.loc);
+    if (gen.lineProfile != nullptr && !llvm::isa<ConstDeclASTNode, VarDeclASTNode, ArrayDeclASTNode>(statement))
+        gen.lineProfile->count(gen.builder, statement.getLocation(), LineProfile::Statement);
+    statement.codegen(gen);
+}
+
+// Emits a statement list, stops at the first statement that ends the block (break, continue):
+// whatever follows it in the list is unreachable
+static void codegenBody(GenContext& gen, const std::vector<std::unique_ptr<StatementASTNode>>& body)
+{
+    for (const auto& statement : body) {
+        emitStatement(gen, *statement);
+        if (gen.isTerminated())
+            return;
+    }
+}
+
+// Falls through to the next block, unless the current one already ended with a jump
+static void branchIfOpen(GenContext& gen, llvm::BasicBlock* target)
+{
+    if (!gen.isTerminated())
+        gen.builder.CreateBr(target);
+}
+
+// Branches on the condition of an if/while/for; with a profile both edges are counted or weighted
+static void branchOn(GenContext& gen, const ExprASTNode& cond, llvm::BasicBlock* BBtrue, llvm::BasicBlock* BBfalse)
+{
+    if (gen.profile == nullptr) {
+        cond.condgen(gen, BBtrue, BBfalse);
+        return;
+    }
+
+    unsigned counter = gen.profile->allocateBranch();
+    cond.condgen(gen, BBtrue, gen.profile->falseTarget(gen.builder, counter, BBfalse));
+    gen.profile->finishBranch(gen.builder, counter, BBtrue, BBfalse);
+}
+
 llvm::Value* WhileASTNode::codegen(GenContext& gen) const {
     llvm::Function* currentFunction = gen.builder.GetInsertBlock()->getParent();
 
     llvm::BasicBlock* BBcond = llvm::BasicBlock::Create(gen.ctx, "cond", currentFunction);
     llvm::BasicBlock* BBbody = llvm::BasicBlock::Create(gen.ctx, "body", currentFunction);
     llvm::BasicBlock* BBafter = llvm::BasicBlock::Create(gen.ctx, "after", currentFunction);
-    gen .BBreak = BBafter;
 
     // Branch to the condition block
     gen.builder.CreateBr(BBcond);
 
     // Emit code for the condition block
     gen.builder.SetInsertPoint(BBcond);
-    llvm::Value* cond = m_cond->codegen(gen);
-    gen.builder.CreateCondBr(cond, BBbody, BBafter);
+    branchOn(gen, *m_cond, BBbody, BBafter);
 
-    // Emit code for the body block
+    // Emit code for the body block, break leaves the loop and continue re-evaluates the condition
     gen.builder.SetInsertPoint(BBbody);
-    for (const auto& statement : m_body) {
-        llvm::Value* result = statement->codegen(gen);
-        // Check if the result of the statement is a break instruction
-        if ( result != nullptr )
-        {
-            llvm::Instruction* instruction = llvm::dyn_cast<llvm::Instruction>(result);
-            if (instruction != nullptr && instruction->getName() == "break") {
-                // If it's a break, branch to the after block
-                gen.builder.CreateBr(BBafter);
-                gen.builder.SetInsertPoint(BBafter);
-                return nullptr;
-            }
-        }
-        gen .BBreak = BBafter;
-    }
+    if (gen.lineProfile != nullptr)
+        gen.lineProfile->count(gen.builder, getLocation(), LineProfile::Iteration);
+    gen.loops.push_back({BBafter, BBcond});
+    codegenBody(gen, m_body);
+    gen.loops.pop_back();
 
-    // Branch back to the condition block
-    gen.builder.CreateBr(BBcond);
+    // Branch back to the condition block, the jump belongs to the loop rather than its last statement
+    setDebugLocation(gen, getLocation());
+    branchIfOpen(gen, BBcond);
 
     // Emit code for the after block
     gen.builder.SetInsertPoint(BBafter);
@@ -302,8 +428,8 @@ llvm::Value* ForASTNode::codegen(GenContext& gen) const {
     llvm::BasicBlock* BBinit = llvm::BasicBlock::Create(gen.ctx, "init", currentFunction);
     llvm::BasicBlock* BBcond = llvm::BasicBlock::Create(gen.ctx, "cond", currentFunction);
     llvm::BasicBlock* BBbody = llvm::BasicBlock::Create(gen.ctx, "body", currentFunction);
+    llvm::BasicBlock* BBinc = llvm::BasicBlock::Create(gen.ctx, "inc", currentFunction);
     llvm::BasicBlock* BBafter = llvm::BasicBlock::Create(gen.ctx, "after", currentFunction);
-    gen .BBreak = BBafter;
 
     // Branch to the initialization block
     gen.builder.CreateBr(BBinit);
@@ -315,29 +441,20 @@ llvm::Value* ForASTNode::codegen(GenContext& gen) const {
 
     // Emit code for the condition block
     gen.builder.SetInsertPoint(BBcond);
-    llvm::Value* cond = m_condition->codegen(gen);
-    gen.builder.CreateCondBr(cond, BBbody, BBafter);
+    branchOn(gen, *m_condition, BBbody, BBafter);
 
-    // Emit code for the body block
+    // Emit code for the body block, break leaves the loop and continue goes on with the next iteration
     gen.builder.SetInsertPoint(BBbody);
-    for (const auto& statement : m_body) {
-        llvm::Value* result = statement->codegen(gen);
-        // Check if the result of the statement is a break instruction
-        if ( result != nullptr )
-        {
-            llvm::Instruction* instruction = llvm::dyn_cast<llvm::Instruction>(result);
-            if (instruction != nullptr && instruction->getName() == "break") {
-                // If it's a break, branch to the after block
-                gen.builder.CreateBr(BBafter);
-                gen.builder.SetInsertPoint(BBafter);  // Set insert point to BBafter before returning
-                return nullptr;
-            }
-        }
-        gen .BBreak = BBafter;
-    }
+    if (gen.lineProfile != nullptr)
+        gen.lineProfile->count(gen.builder, getLocation(), LineProfile::Iteration);
+    gen.loops.push_back({BBafter, BBinc});
+    codegenBody(gen, m_body);
+    gen.loops.pop_back();
+    setDebugLocation(gen, getLocation());
+    branchIfOpen(gen, BBinc);
 
     // Emit code for the increment block
-    gen.builder.SetInsertPoint(gen.builder.GetInsertBlock());  // Set insert point to the current block
+    gen.builder.SetInsertPoint(BBinc);
     m_increment->codegen(gen);
     gen.builder.CreateBr(BBcond);
 
@@ -350,70 +467,48 @@ llvm::Value* ForASTNode::codegen(GenContext& gen) const {
 llvm::Value* IfASTNode::codegen(GenContext& gen) const {
     auto parent = gen.builder.GetInsertBlock()->getParent();
     llvm::BasicBlock* BBbody = llvm::BasicBlock::Create(gen.ctx, "body", parent);
-    llvm::BasicBlock* BBelse = llvm::BasicBlock::Create(gen.ctx, "else", parent);
-    llvm::BasicBlock* BBafter = llvm::BasicBlock::Create(gen.ctx, "after", parent);
+    // The after block is only placed into the function once some branch falls through to it,
+    // without an else branch the condition jumps there directly
+    llvm::BasicBlock* BBafter = llvm::BasicBlock::Create(gen.ctx, "after");
+    llvm::BasicBlock* BBelse = m_bodyFalse.empty() ? BBafter : llvm::BasicBlock::Create(gen.ctx, "else");
 
-    auto cond = m_cond->codegen(gen);
-    gen.builder.CreateCondBr(cond, BBbody, BBelse);
-
-    llvm::Instruction* value = nullptr;
+    branchOn(gen, *m_cond, BBbody, BBelse);
 
     // Generate code for the true body
     gen.builder.SetInsertPoint(BBbody);
-    for (const auto& statement : m_bodyTrue) {
-        llvm::Value* result = statement->codegen(gen);
-        // Check if the result of the statement is a break instruction
-        if ( result != nullptr )
-        {
-            llvm::Instruction* instruction = llvm::dyn_cast<llvm::Instruction>(result);
-            if (instruction != nullptr && instruction->getName() == "break")
-            {
-                // Need to jump
-                gen.builder.CreateBr(gen.BBreak);
-            }
-        }
-    }
-    gen.builder.CreateBr(BBafter);
+    codegenBody(gen, m_bodyTrue);
+    branchIfOpen(gen, BBafter);
 
     // Generate code for the else body
-    parent->getBasicBlockList().push_back(BBelse);
-    gen.builder.SetInsertPoint(BBelse);
-    for (const auto& statement : m_bodyFalse) {
-        llvm::Value* result = statement->codegen(gen);
-        // Check if the result of the statement is a break instruction
-        if ( result != nullptr )
-        {
-            llvm::Instruction* instruction = llvm::dyn_cast<llvm::Instruction>(result);
-            if (instruction != nullptr && instruction->getName() == "break")
-            {
-                // Need to jump
-                gen.builder.CreateBr(gen.BBreak);
-            }
-        }
+    if (BBelse != BBafter) {
+        BBelse->insertInto(parent);
+        gen.builder.SetInsertPoint(BBelse);
+        codegenBody(gen, m_bodyFalse);
+        branchIfOpen(gen, BBafter);
     }
-    gen.builder.CreateBr(BBafter);
 
-    parent->getBasicBlockList().push_back(BBafter);
+    // Both branches jumped away: stay in the terminated block, so that nothing more is emitted after the if
+    if (BBafter->hasNPredecessors(0)) {
+        delete BBafter;
+        return nullptr;
+    }
 
+    BBafter->insertInto(parent);
     gen.builder.SetInsertPoint(BBafter);
 
-
     return nullptr;
 }
 
 llvm::Value* BreakASTNode::codegen(GenContext& gen) const {
-    llvm::Instruction* instruction = llvm::BinaryOperator::Create(llvm::Instruction::Add,
-                                                                  llvm::ConstantInt::get(llvm::Type::getInt32Ty(gen.ctx), 0),
-                                                                  llvm::ConstantInt::get(llvm::Type::getInt32Ty(gen.ctx), 0));
-    instruction->setName("break");
-    return instruction;
+    return gen.builder.CreateBr(gen.loops.back().BBbreak);
+}
+
+llvm::Value* ContinueASTNode::codegen(GenContext& gen) const {
+    return gen.builder.CreateBr(gen.loops.back().BBcontinue);
 }
 
 llvm::Value* ConstDeclASTNode::codegen(GenContext& gen) const
 {
-    assert(!gen.symbolTable.contains(m_const));
-
-
     // Generate code for the expression
     llvm::Value * exprValue = m_expr->codegen(gen);
 
@@ -426,23 +521,20 @@ llvm::Value* ConstDeclASTNode::codegen(GenContext& gen) const
     // Create an alloca instruction to store the constant in the symbol table
     llvm::AllocaInst* constStore = gen.builder.CreateAlloca(constValue->getType(), nullptr, m_const);
     gen.builder.CreateStore(constValue, constStore);
+    if (gen.debugInfo != nullptr)
+        gen.debugInfo->declareVariable(gen.builder, m_const, constStore, getLocation(), true);
 
-    // Add the constant symbol to the symbol table
-    Symbol constSymbol;
-    constSymbol.name = m_const;
-    constSymbol.type = new TypeASTNode (Type::INT);
-    constSymbol.store = constStore;
-    gen.symbolTable[m_const] = constSymbol;
+    gen.symbols[m_symbol].store = constStore;
 
     return nullptr;
 }
 
 llvm::Value* VarDeclASTNode::codegen(GenContext& gen) const
 {
-    assert(!gen.symbolTable.contains(m_var));
-
     llvm::AllocaInst * store = gen.builder.CreateAlloca(m_type->genType(gen), 0, m_var);
-    gen.symbolTable[m_var] = {m_var, m_type.get(), store};
+    if (gen.debugInfo != nullptr)
+        gen.debugInfo->declareVariable(gen.builder, m_var, store, getLocation());
+    gen.symbols[m_symbol].store = store;
 
     return nullptr;
 }
@@ -452,24 +544,46 @@ llvm::Value* ArrayDeclASTNode::codegen(GenContext& gen) const {
     llvm::Type* elementType = m_type->genType(gen);
     llvm::ArrayType* arrayType = llvm::ArrayType::get(elementType, m_upperBound - m_lowerBound + 1);
     llvm::AllocaInst* arrayAlloca = gen.builder.CreateAlloca(arrayType, nullptr, m_var);
+    if (gen.debugInfo != nullptr)
+        gen.debugInfo->declareVariable(gen.builder, m_var, arrayAlloca, getLocation(), false, m_lowerBound);
 
-    gen.symbolTable[m_var] = {m_var, m_type.get(), arrayAlloca, m_upperBound - m_lowerBound + 1, m_lowerBound };
+    gen.symbols[m_symbol].store = arrayAlloca;
 
     return nullptr;
 }
 
 
 llvm::Value* ProgramASTNode::codegen(GenContext& gen) const
+{
+    codegenEntry(gen);
+    codegenBody(gen, m_statements);
+    codegenExit(gen);
+    return nullptr;
+}
+
+void ProgramASTNode::codegenEntry(GenContext& gen) const
 {
     llvm::FunctionType* ftMain = llvm::FunctionType::get(llvm::Type::getInt32Ty(gen.ctx), false);
     llvm::Function* fMain = llvm::Function::Create(ftMain, llvm::Function::ExternalLinkage, "main", gen.module);
     llvm::BasicBlock* BB = llvm::BasicBlock::Create(gen.ctx, "entry", fMain);
     gen.builder.SetInsertPoint(BB);
+    if (gen.debugInfo != nullptr) {
+        gen.debugInfo->enterFunction(*fMain, getLocation());
+        gen.debugInfo->setLocation(gen.builder, getLocation());
+    }
+    if (gen.profile != nullptr)
+        gen.profile->enterFunction(gen.builder, *fMain);
+}
 
-    for (const auto& s : m_statements)
-        s->codegen(gen);
-
-    gen.builder.CreateRet(llvm::ConstantInt::get(llvm::Type::getInt32Ty(gen.ctx), 0));
+void ProgramASTNode::codegenStatement(GenContext& gen, const StatementASTNode& statement)
+{
+    if (!gen.isTerminated())
+        emitStatement(gen, statement);
+}
 
-    return nullptr;
+void ProgramASTNode::codegenExit(GenContext& gen) const
+{
+    setDebugLocation(gen, m_endLoc);
+    if (!gen.isTerminated())
+        gen.builder.CreateRet(llvm::ConstantInt::get(llvm::Type::getInt32Ty(gen.ctx), 0));
 }
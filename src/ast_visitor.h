@@ -0,0 +1,181 @@
+#pragma once
+#include <llvm/Support/Casting.h>
+
+#include "ast.h"
+
+/*
+ * Dispatches on ASTNode::getKind() instead of going through virtual calls.
+ * Derived classes override the visitXxx they are interested in; everything else falls back to the
+ * category (visitExpr, visitStatement), then to visitNode. Use as:
+ *
+ *   class Counter : public ASTVisitor<Counter> {
+ *   public:
+ *       void visitBinOp(const BinOpASTNode& node) { ... }
+ *   };
+ */
+template <typename Derived, typename RetTy = void>
+class ASTVisitor {
+public:
+    RetTy visit(const ASTNode& node)
+    {
+        switch (node.getKind()) {
+            case ASTKind::Type:
+                return derived().visitType(llvm::cast<TypeASTNode>(node));
+            case ASTKind::BinOp:
+                return derived().visitBinOp(llvm::cast<BinOpASTNode>(node));
+            case ASTKind::UnaryOp:
+                return derived().visitUnaryOp(llvm::cast<UnaryOpASTNode>(node));
+            case ASTKind::Literal:
+                return derived().visitLiteral(llvm::cast<LiteralASTNode>(node));
+            case ASTKind::FloatLiteral:
+                return derived().visitFloatLiteral(llvm::cast<FloatLiteralASTNode>(node));
+            case ASTKind::DeclRef:
+                return derived().visitDeclRef(llvm::cast<DeclRefASTNode>(node));
+            case ASTKind::DeclArrayRef:
+                return derived().visitDeclArrayRef(llvm::cast<DeclArrayRefASTNode>(node));
+            case ASTKind::If:
+                return derived().visitIf(llvm::cast<IfASTNode>(node));
+            case ASTKind::While:
+                return derived().visitWhile(llvm::cast<WhileASTNode>(node));
+            case ASTKind::Break:
+                return derived().visitBreak(llvm::cast<BreakASTNode>(node));
+            case ASTKind::Continue:
+                return derived().visitContinue(llvm::cast<ContinueASTNode>(node));
+            case ASTKind::FunCall:
+                return derived().visitFunCall(llvm::cast<FunCallASTNode>(node));
+            case ASTKind::ConstDecl:
+                return derived().visitConstDecl(llvm::cast<ConstDeclASTNode>(node));
+            case ASTKind::VarDecl:
+                return derived().visitVarDecl(llvm::cast<VarDeclASTNode>(node));
+            case ASTKind::ArrayDecl:
+                return derived().visitArrayDecl(llvm::cast<ArrayDeclASTNode>(node));
+            case ASTKind::Assign:
+                return derived().visitAssign(llvm::cast<AssignASTNode>(node));
+            case ASTKind::For:
+                return derived().visitFor(llvm::cast<ForASTNode>(node));
+            case ASTKind::Program:
+                return derived().visitProgram(llvm::cast<ProgramASTNode>(node));
+        }
+        llvm_unreachable("unknown AST node kind");
+    }
+
+    // Categories
+    RetTy visitNode(const ASTNode&) { return RetTy(); }
+    RetTy visitExpr(const ExprASTNode& node) { return derived().visitNode(node); }
+    RetTy visitVar(const VarASTNode& node) { return derived().visitExpr(node); }
+    RetTy visitStatement(const StatementASTNode& node) { return derived().visitNode(node); }
+
+    // Concrete nodes
+    RetTy visitType(const TypeASTNode& node) { return derived().visitNode(node); }
+    RetTy visitBinOp(const BinOpASTNode& node) { return derived().visitExpr(node); }
+    RetTy visitUnaryOp(const UnaryOpASTNode& node) { return derived().visitExpr(node); }
+    RetTy visitLiteral(const LiteralASTNode& node) { return derived().visitExpr(node); }
+    RetTy visitFloatLiteral(const FloatLiteralASTNode& node) { return derived().visitExpr(node); }
+    RetTy visitDeclRef(const DeclRefASTNode& node) { return derived().visitVar(node); }
+    RetTy visitDeclArrayRef(const DeclArrayRefASTNode& node) { return derived().visitVar(node); }
+    RetTy visitIf(const IfASTNode& node) { return derived().visitStatement(node); }
+    RetTy visitWhile(const WhileASTNode& node) { return derived().visitStatement(node); }
+    RetTy visitBreak(const BreakASTNode& node) { return derived().visitStatement(node); }
+    RetTy visitContinue(const ContinueASTNode& node) { return derived().visitStatement(node); }
+    RetTy visitFunCall(const FunCallASTNode& node) { return derived().visitStatement(node); }
+    RetTy visitConstDecl(const ConstDeclASTNode& node) { return derived().visitStatement(node); }
+    RetTy visitVarDecl(const VarDeclASTNode& node) { return derived().visitStatement(node); }
+    RetTy visitArrayDecl(const ArrayDeclASTNode& node) { return derived().visitStatement(node); }
+    RetTy visitAssign(const AssignASTNode& node) { return derived().visitStatement(node); }
+    RetTy visitFor(const ForASTNode& node) { return derived().visitStatement(node); }
+    RetTy visitProgram(const ProgramASTNode& node) { return derived().visitNode(node); }
+
+private:
+    Derived& derived() { return *static_cast<Derived*>(this); }
+};
+
+/*
+ * Visits a node and then all of its children, parents before children and in source order.
+ * Analyses that need the whole tree (counting, collecting names, ...) only override the visitXxx they need.
+ */
+template <typename Derived>
+class RecursiveASTVisitor : public ASTVisitor<Derived> {
+public:
+    void traverse(const ASTNode* node)
+    {
+        if (node == nullptr)
+            return;
+
+        this->visit(*node);
+
+        switch (node->getKind()) {
+            case ASTKind::BinOp: {
+                auto* binOp = llvm::cast<BinOpASTNode>(node);
+                traverse(binOp->m_lhs.get());
+                traverse(binOp->m_rhs.get());
+                break;
+            }
+            case ASTKind::UnaryOp:
+                traverse(llvm::cast<UnaryOpASTNode>(node)->getExpr());
+                break;
+            case ASTKind::DeclArrayRef:
+                traverse(llvm::cast<DeclArrayRefASTNode>(node)->m_index.get());
+                break;
+            case ASTKind::If: {
+                auto* ifNode = llvm::cast<IfASTNode>(node);
+                traverse(ifNode->m_cond.get());
+                traverseList(ifNode->m_bodyTrue);
+                traverseList(ifNode->m_bodyFalse);
+                break;
+            }
+            case ASTKind::While: {
+                auto* whileNode = llvm::cast<WhileASTNode>(node);
+                traverse(whileNode->m_cond.get());
+                traverseList(whileNode->m_body);
+                break;
+            }
+            case ASTKind::FunCall: {
+                auto* call = llvm::cast<FunCallASTNode>(node);
+                traverseList(call->m_Refs);
+                traverseList(call->m_Exprs);
+                break;
+            }
+            case ASTKind::ConstDecl:
+                traverse(llvm::cast<ConstDeclASTNode>(node)->m_expr.get());
+                break;
+            case ASTKind::VarDecl:
+                traverse(llvm::cast<VarDeclASTNode>(node)->m_type.get());
+                break;
+            case ASTKind::ArrayDecl:
+                traverse(llvm::cast<ArrayDeclASTNode>(node)->m_type.get());
+                break;
+            case ASTKind::Assign: {
+                auto* assign = llvm::cast<AssignASTNode>(node);
+                traverse(assign->m_var.get());
+                traverse(assign->m_expr.get());
+                break;
+            }
+            case ASTKind::For: {
+                auto* forNode = llvm::cast<ForASTNode>(node);
+                traverse(forNode->m_initialization.get());
+                traverse(forNode->m_condition.get());
+                traverseList(forNode->m_body);
+                traverse(forNode->m_increment.get());
+                break;
+            }
+            case ASTKind::Program:
+                traverseList(llvm::cast<ProgramASTNode>(node)->m_statements);
+                break;
+            case ASTKind::Type:
+            case ASTKind::Literal:
+            case ASTKind::FloatLiteral:
+            case ASTKind::DeclRef:
+            case ASTKind::Break:
+            case ASTKind::Continue:
+                break;
+        }
+    }
+
+private:
+    template <typename T>
+    void traverseList(const std::vector<std::unique_ptr<T>>& nodes)
+    {
+        for (const auto& node : nodes)
+            traverse(node.get());
+    }
+};
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 int writeln(int x) {
     printf("%d\n", x);
@@ -8,7 +9,102 @@ int write(int x) {
     printf("%d", x);
     return 0;
 }
+int writeln_real(double x) {
+    printf("%g\n", x);
+    return 0;
+}
+int write_real(double x) {
+    printf("%g", x);
+    return 0;
+}
 int readln(int *x) {
     scanf("%d", x);
     return 0;
 }
+
+/*
+ * Branch profile of a program compiled with --profile-generate (see src/Profile.h).
+ * The counters are added to the profile file at exit; MILA_PROFILE_FILE overrides its name.
+ */
+static long long *profileCounters;
+static int profileCount;
+static unsigned long long profileHash;
+static const char *profilePath;
+
+static void writeProfile(void) {
+    const char *path = getenv("MILA_PROFILE_FILE");
+    if (path == NULL || *path == '\0')
+        path = profilePath;
+
+    /* Counts of earlier runs of the same program are added up */
+    FILE *in = fopen(path, "r");
+    if (in != NULL) {
+        int version, count;
+        unsigned long long hash;
+        if (fscanf(in, "mila-profile %d %llx %d", &version, &hash, &count) == 3
+            && version == 1 && hash == profileHash && count == profileCount) {
+            long long *previous = calloc(count, sizeof(long long));
+            int i = 0;
+            while (previous != NULL && i < count && fscanf(in, "%lld", &previous[i]) == 1)
+                i++;
+            if (i == count)
+                for (i = 0; i < count; i++)
+                    profileCounters[i] += previous[i];
+            free(previous);
+        }
+        fclose(in);
+    }
+
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot write profile %s\n", path);
+        return;
+    }
+    fprintf(out, "mila-profile 1\n%llx\n%d\n", profileHash, profileCount);
+    for (int i = 0; i < profileCount; i++)
+        fprintf(out, "%lld\n", profileCounters[i]);
+    fclose(out);
+}
+
+void __mila_profile_init(long long *counters, int count, long long hash, const char *path) {
+    profileCounters = counters;
+    profileCount = count;
+    profileHash = (unsigned long long) hash;
+    profilePath = path;
+    atexit(writeProfile);
+}
+
+/*
+ * Execution counts of a program compiled with --line-profile (see src/Profile.h), written at exit
+ * together with the source position of every counter. MILA_LINES_FILE overrides the file name.
+ */
+static long long *lineCounters;
+static int lineCount;
+static const int *lineSites;
+static const char *lineSource;
+static const char *linePath;
+
+static void writeLines(void) {
+    const char *path = getenv("MILA_LINES_FILE");
+    if (path == NULL || *path == '\0')
+        path = linePath;
+
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot write line profile %s\n", path);
+        return;
+    }
+    fprintf(out, "mila-lines 1\n%s\n%d\n", lineSource, lineCount);
+    for (int i = 0; i < lineCount; i++)
+        fprintf(out, "%d %d %c %lld\n", lineSites[3 * i], lineSites[3 * i + 1], lineSites[3 * i + 2], lineCounters[i]);
+    fclose(out);
+}
+
+void __mila_lines_init(long long *counters, int count, const int *sites, const char *source, const char *path) {
+    lineCounters = counters;
+    lineCount = count;
+    lineSites = sites;
+    lineSource = source;
+    linePath = path;
+    atexit(writeLines);
+}
@@ -1,63 +1,136 @@
-#include <llvm/ADT/APFloat.h>
-#include <llvm/ADT/STLExtras.h>
-#include <llvm/IR/BasicBlock.h>
-#include <llvm/IR/Constants.h>
-#include <llvm/IR/DerivedTypes.h>
-#include <llvm/IR/Function.h>
-#include <llvm/IR/IRBuilder.h>
-#include <llvm/IR/LLVMContext.h>
-#include <llvm/IR/LegacyPassManager.h>
-#include <llvm/IR/Module.h>
-#include <llvm/IR/Type.h>
-#include <llvm/IR/Verifier.h>
-#include <llvm/Support/raw_ostream.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Support/CommandLine.h>
 
-#include "Parser.h"
+#include "Driver.h"
+#include "Server.h"
 
+static llvm::cl::OptionCategory MilaCategory("Mila compiler options");
 
+static llvm::cl::opt<std::string> InputFile(llvm::cl::Positional, llvm::cl::desc("<input file>"), llvm::cl::init("-"),
+                                            llvm::cl::cat(MilaCategory));
 
+static llvm::cl::opt<std::string> OutputFile("o", llvm::cl::desc("Output file, '-' for standard output"),
+                                             llvm::cl::value_desc("filename"), llvm::cl::init("-"),
+                                             llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<EmitKind> Emit("emit", llvm::cl::desc("Output format"), llvm::cl::init(EmitKind::LLVMIR),
+                                    llvm::cl::values(clEnumValN(EmitKind::LLVMIR, "ll", "Textual LLVM IR (default)"),
+                                                     clEnumValN(EmitKind::Bitcode, "bc", "LLVM bitcode"),
+                                                     clEnumValN(EmitKind::Object, "obj", "Object file of the host"),
+                                                     clEnumValN(EmitKind::Assembly, "asm", "Assembly of the host"),
+                                                     clEnumValN(EmitKind::AST, "ast", "Binary AST of the parsed program")),
+                                    llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<unsigned> OptLevel("O", llvm::cl::desc("Optimization level (0-3)"), llvm::cl::Prefix,
+                                        llvm::cl::init(0), llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<bool> DebugInfo("g", llvm::cl::desc("Emit DWARF debug info, so debuggers and profilers see Mila source lines"),
+                                     llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<bool> Pipeline("pipeline", llvm::cl::desc("Lex on a separate thread and generate every top-level statement as soon as it is parsed"),
+                                    llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<std::string> ProfileGenerate("profile-generate",
+                                                  llvm::cl::desc("Count the branches of the program, it adds them to <file> at exit (default mila.profile)"),
+                                                  llvm::cl::value_desc("file"), llvm::cl::ValueOptional, llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<std::string> ProfileUse("profile-use", llvm::cl::desc("Optimize with the branch profile written by a --profile-generate build"),
+                                             llvm::cl::value_desc("file"), llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<std::string> LineProfileFile("line-profile",
+                                                  llvm::cl::desc("Count executions of every statement and loop iteration, the program writes them to <file> at exit (default mila.lines)"),
+                                                  llvm::cl::value_desc("file"), llvm::cl::ValueOptional, llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<std::string> LineReport("line-report", llvm::cl::desc("Print the input annotated with the counts of a --line-profile run"),
+                                             llvm::cl::value_desc("file"), llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<std::string> CacheDir("cache-dir", llvm::cl::desc("Reuse the output of earlier compilations of the same input kept in <dir>"),
+                                           llvm::cl::value_desc("dir"), llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<std::string> Server("server", llvm::cl::desc("Run as a compile server listening on the Unix socket <path>"),
+                                         llvm::cl::value_desc("path"), llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<unsigned> ServerThreads("server-threads", llvm::cl::desc("Compilations the server runs at once (default: one per core)"),
+                                             llvm::cl::init(0), llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<std::string> Connect("connect", llvm::cl::desc("Have the compile server at <path> compile, compile locally when there is none"),
+                                          llvm::cl::value_desc("path"), llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<bool> TimeReport("time-report", llvm::cl::desc("Report time and peak memory of each compiler phase"),
+                                      llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<std::string> StatsFile("stats-file", llvm::cl::desc("Write the time report and counters as JSON"),
+                                            llvm::cl::value_desc("filename"), llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<bool> TimeTrace("time-trace", llvm::cl::desc("Write a chrome://tracing / Perfetto trace of the compilation"),
+                                     llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<std::string> TimeTraceFile("time-trace-file", llvm::cl::desc("Trace file (default: <output>.time-trace, <input>.time-trace with -o -)"),
+                                                llvm::cl::value_desc("filename"), llvm::cl::cat(MilaCategory));
+
+static llvm::cl::opt<unsigned> TimeTraceGranularity("time-trace-granularity",
+                                                    llvm::cl::desc("Shortest span in the trace, in microseconds"),
+                                                    llvm::cl::init(500), llvm::cl::cat(MilaCategory));
 
-using namespace std;
 int main (int argc, char *argv[])
 {
-    Parser parser;
+    // --stats is LLVM's own -stats flag, it also turns on the statistics of the LLVM passes
+    llvm::cl::HideUnrelatedOptions(MilaCategory);
+    if (llvm::cl::Option* stats = llvm::cl::getRegisteredOptions().lookup("stats")) {
+        stats->addCategory(MilaCategory);
+        stats->setHiddenFlag(llvm::cl::NotHidden);
+    }
+    llvm::cl::ParseCommandLineOptions(argc, argv, "Mila compiler\n");
 
-    if (!parser.Parse()) {
+    if (!Server.empty())
+        return RunServer(Server, ServerThreads);
+
+    if (OptLevel > 3) {
+        llvm::errs() << "Invalid optimization level -O" << OptLevel << "\n";
         return 1;
     }
 
+    if (ProfileGenerate.getNumOccurrences() > 0 && !ProfileUse.empty()) {
+        llvm::errs() << "--profile-generate and --profile-use cannot be used together\n";
+        return 1;
+    }
 
-    std::error_code error;
-    llvm::raw_fd_ostream outputFile("/home/grachale/PJP/testingSemestral/generatedCode.ll", error);
+    // Like llvm-as, binary output is not dumped on a terminal
+    bool binary = Emit == EmitKind::Bitcode || Emit == EmitKind::Object || Emit == EmitKind::AST;
+    if (binary && OutputFile == "-" && LineReport.empty() && llvm::outs().is_displayed()) {
+        llvm::errs() << "Not writing a binary file to the terminal, redirect the output or use -o <file>\n";
+        return 1;
+    }
 
+    CompileOptions options;
+    options.inputFile = InputFile;
+    options.outputFile = OutputFile;
+    options.emit = Emit;
+    options.optLevel = OptLevel;
+    options.debugInfo = DebugInfo;
+    options.pipeline = Pipeline;
+    if (ProfileGenerate.getNumOccurrences() > 0)
+        options.profileGenerate = ProfileGenerate.empty() ? std::string("mila.profile") : ProfileGenerate.getValue();
+    options.profileUse = ProfileUse;
+    if (LineProfileFile.getNumOccurrences() > 0)
+        options.lineProfile = LineProfileFile.empty() ? std::string("mila.lines") : LineProfileFile.getValue();
+    options.lineReport = LineReport;
+    options.cacheDir = CacheDir;
+    options.timeReport = TimeReport;
+    options.stats = llvm::AreStatisticsEnabled();
+    options.statsFile = StatsFile;
+    options.timeTrace = TimeTrace || !TimeTraceFile.empty();
+    options.timeTraceFile = TimeTraceFile;
+    options.timeTraceGranularity = TimeTraceGranularity;
 
-    if (!error) {
-        parser.Generate().print(outputFile, nullptr);
-    } else {
-        llvm::errs() << "Error opening file: " << error.message() << "\n";
+    // The trace profiler keeps per-process state, and a server's CPU time and peak RSS are those of all its
+    // compilations: traced or measured compilations are never sent to a server
+    bool measured = options.timeTrace || options.timeReport || options.stats || !options.statsFile.empty();
+    if (!Connect.empty() && !measured) {
+        int result = CompileRemote(Connect, options);
+        if (result >= 0)
+            return result;
     }
 
-//    Lexer lexer;
-//    while (1)
-//    {
-//        cout << getTokenName(lexer .gettok()) << endl;
-//        cout << "Number - " << lexer .numVal() << endl;
-//    }
-
-//    Parser parser;
-//
-//    parser . Parse();
-
-//    Lexer lexer;
-//
-//    auto token = lexer .gettok();
-//
-//    while ( token != Token::tok_eof )
-//    {
-//        cout << getTokenName(token) << endl;
-//        token = lexer .gettok();
-//    }
-//    parser.Generate().print(llvm::outs(), nullptr);
-
-    return 0;
+    return Compile(options);
 }